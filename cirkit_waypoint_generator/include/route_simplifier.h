@@ -0,0 +1,169 @@
+#ifndef ROUTE_SIMPLIFIER_H_
+#define ROUTE_SIMPLIFIER_H_
+
+#include <math.h>
+#include <stddef.h>
+
+#include <vector>
+
+struct RoutePose {
+  double x;
+  double y;
+  double yaw;
+};
+
+/**
+ * Online route simplification for the waypoint generator.
+ * Poses come one by one (amcl_pose); a pose becomes a waypoint only when the
+ * straight segment from the last waypoint could no longer represent the
+ * poses passed since then, i.e. one of them is farther than
+ * lateral_tolerance from the segment or its yaw differs from the segment
+ * heading by more than heading_tolerance. Then the last pose that still
+ * fitted is emitted (streaming Douglas-Peucker with an opening window).
+ * The window is bounded by max_lookback poses, so add() is O(max_lookback).
+ */
+class RouteSimplifier {
+public:
+  struct Params {
+    Params()
+      : lateral_tolerance(0.3), heading_tolerance(M_PI / 4.0),
+        max_distance(10.0), min_heading_distance(0.2), max_lookback(200)
+    {}
+    double lateral_tolerance;    // [m] 区間から離れてよい距離
+    double heading_tolerance;    // [rad] 区間の向きとロボットの向きの差
+    double max_distance;         // [m] waypointの間隔の上限
+    double min_heading_distance; // [m] これより短い区間は向きを前のwaypointの向きと比べる
+    size_t max_lookback;         // 窓に溜める位置の数の上限
+  };
+
+  static constexpr double kMinStep = 0.01; // [m], [rad] 前の位置からこれ未満しか動いていなければ捨てる
+
+  RouteSimplifier() : has_anchor_(false) {}
+
+  void setParams(const Params &params) {
+    params_ = params;
+    window_.reserve(params_.max_lookback);
+  }
+
+  const Params& params() const {
+    return params_;
+  }
+
+  void reset() {
+    has_anchor_ = false;
+    window_.clear();
+  }
+
+  /**
+   * Add a pose. Poses that become waypoints are appended to waypoints
+   * (usually none, at most two). Returns the number appended.
+   */
+  size_t add(const RoutePose &pose, std::vector<RoutePose> &waypoints) {
+    size_t before = waypoints.size();
+    if (!has_anchor_) { // 最初の位置はそのままwaypointにする
+      emit(pose, waypoints);
+      return 1;
+    }
+    const RoutePose &previous = window_.empty() ? anchor_ : window_.back();
+    if (hypot(pose.x - previous.x, pose.y - previous.y) < kMinStep
+        && fabs(normalizeAngle(pose.yaw - previous.yaw)) < kMinStep) { // 止まっている間は溜めない
+      return 0;
+    }
+    while (true) {
+      if (window_.size() < params_.max_lookback && fits(pose)) {
+        window_.push_back(pose);
+        break;
+      }
+      if (window_.empty()) { // 前のwaypointから直接でも収まらない
+        emit(pose, waypoints);
+        break;
+      }
+      // 最後に収まっていた位置をwaypointにして, そこから区間を作り直す
+      RoutePose last = window_.back();
+      window_.clear();
+      emit(last, waypoints);
+    }
+    return waypoints.size() - before;
+  }
+
+  // まだwaypointになっていない最後の位置をwaypointにする(記録の終わり)
+  bool flush(std::vector<RoutePose> &waypoints) {
+    if (window_.empty()) {
+      return false;
+    }
+    RoutePose last = window_.back();
+    window_.clear();
+    emit(last, waypoints);
+    return true;
+  }
+
+  size_t pending() const {
+    return window_.size();
+  }
+
+  static double normalizeAngle(double angle) {
+    return atan2(sin(angle), cos(angle));
+  }
+
+private:
+  void emit(const RoutePose &pose, std::vector<RoutePose> &waypoints) {
+    anchor_ = pose;
+    has_anchor_ = true;
+    waypoints.push_back(pose);
+  }
+
+  // anchor_からendまでの区間で窓の中の位置とendを表せるか
+  bool fits(const RoutePose &end) const {
+    double dx = end.x - anchor_.x;
+    double dy = end.y - anchor_.y;
+    double length = sqrt(dx*dx + dy*dy);
+    if (length > params_.max_distance) {
+      return false;
+    }
+    if (length < params_.min_heading_distance) { // その場回転など. 前のwaypointの近くで向きだけ見る
+      if (fabs(normalizeAngle(end.yaw - anchor_.yaw)) > params_.heading_tolerance) {
+        return false;
+      }
+      for (size_t i = 0; i < window_.size(); ++i) {
+        const RoutePose &p = window_[i];
+        if (hypot(p.x - anchor_.x, p.y - anchor_.y) > params_.lateral_tolerance
+            || fabs(normalizeAngle(p.yaw - anchor_.yaw)) > params_.heading_tolerance) {
+          return false;
+        }
+      }
+      return true;
+    }
+    double ux = dx / length;
+    double uy = dy / length;
+    double heading = atan2(dy, dx);
+    if (fabs(normalizeAngle(end.yaw - heading)) > params_.heading_tolerance) {
+      return false;
+    }
+    for (size_t i = 0; i < window_.size(); ++i) {
+      const RoutePose &p = window_[i];
+      double px = p.x - anchor_.x;
+      double py = p.y - anchor_.y;
+      double along = px * ux + py * uy;
+      double error;
+      if (along < 0.0) {
+        error = sqrt(px*px + py*py);
+      } else if (along > length) {
+        error = hypot(p.x - end.x, p.y - end.y);
+      } else {
+        error = fabs(px * uy - py * ux);
+      }
+      if (error > params_.lateral_tolerance
+          || fabs(normalizeAngle(p.yaw - heading)) > params_.heading_tolerance) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  Params params_;
+  bool has_anchor_;
+  RoutePose anchor_;              // 最後のwaypoint
+  std::vector<RoutePose> window_; // anchor_より後の, まだwaypointにしていない位置
+};
+
+#endif
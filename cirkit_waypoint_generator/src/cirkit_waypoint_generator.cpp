@@ -4,25 +4,29 @@
 #include <interactive_markers/menu_handler.h>
 #include <nav_msgs/Odometry.h>
 #include <tf/tf.h>
-#include <tf/transform_broadcaster.h>
+#include <tf2_ros/static_transform_broadcaster.h>
+#include <tf2_ros/transform_broadcaster.h>
 #include <visualization_msgs/MarkerArray.h>
+#include <cirkit_waypoint_io/waypoint_binary.h>
 #include <cirkit_waypoint_manager_msgs/WaypointArray.h>
 
 #include <math.h>
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <unordered_map>
 
-#include <boost/tokenizer.hpp>
 #include <boost/shared_array.hpp>
 #include <boost/program_options.hpp>
 
 #include <geometry_msgs/PoseStamped.h>
 
+#include "route_simplifier.h"
+
 using namespace visualization_msgs;
 
-typedef boost::tokenizer<boost::char_separator<char> > tokenizer;
 boost::shared_ptr<interactive_markers::InteractiveMarkerServer> server;
 
 class CirkitWaypointGenerator
@@ -34,52 +38,83 @@ public:
     ros::NodeHandle n("~");
     n.param("dist_th", dist_th_, 1.0); // distance threshold [m]
     n.param("yaw_th", yaw_th_, 45.0*3.1415/180.0); // yaw threshold [rad]
+    // true : 横ずれと向きのずれが許容値に収まる間はwaypointを置かない(dist_th, yaw_thは使わない)
+    n.param("simplify", simplify_, true);
+    RouteSimplifier::Params simplifier_params;
+    n.param("lateral_tolerance", simplifier_params.lateral_tolerance, 0.3); // [m]
+    n.param("heading_tolerance", simplifier_params.heading_tolerance, yaw_th_); // [rad]
+    n.param("max_waypoint_distance", simplifier_params.max_distance, 10.0); // [m]
+    int lookback;
+    n.param("simplify_lookback", lookback, 200); // 1つの区間で振り返る位置の数
+    simplifier_params.max_lookback = std::max(1, lookback);
+    simplifier_.setParams(simplifier_params);
+    n.param("flush_timeout", flush_timeout_, 2.0); // [s] 位置が来なくなったら最後の位置をwaypointにする
+    // waypointのtf frame. all : 全部を/tf_staticに1つのmsgで(変わったときだけ),
+    // window : ロボットからwaypoint_frame_radius以内だけを/tfに, none : 出さない
+    n.param<std::string>("waypoint_frames", waypoint_frames_, "all");
+    n.param("waypoint_frame_radius", waypoint_frame_radius_, 10.0); // [m]
+    n.param("waypoint_frame_period", waypoint_frame_period_, 0.5);  // [s] windowのときの周期
+    if(waypoint_frames_ != "all" && waypoint_frames_ != "window" && waypoint_frames_ != "none")
+    {
+      ROS_ERROR_STREAM("Unknown waypoint_frames : " << waypoint_frames_ << ", use all.");
+      waypoint_frames_ = "all";
+    }
+    has_robot_pose_ = false;
+    n.param("publish_period", publish_period_, 0.1); // [s] 追加, 編集をまとめてpublishする周期
+    // 0より大きいとき, ロボット(またはfocus_point)からこの距離以内のwaypointだけinteractive markerにして
+    // 残りは/waypoint_overviewの1つのmarkerで表示する
+    n.param("lod_radius", lod_radius_, 0.0); // [m]
+    lod_dirty_ = false;
+    has_focus_ = false;
+    has_lod_center_ = false;
     odom_sub_ = nh_.subscribe<geometry_msgs::PoseWithCovarianceStamped>("/amcl_pose",
                               1,
                               &CirkitWaypointGenerator::addWaypoint, this);
     // add
     ndt_pose_sub_ = nh_.subscribe<geometry_msgs::PoseStamped>("/ndt_pose", 1, &CirkitWaypointGenerator::addWaypointNDT, this);
     clicked_sub_ = nh_.subscribe("clicked_point", 1, &CirkitWaypointGenerator::clickedPointCallback, this);
-    reach_marker_pub_ = nh_.advertise<visualization_msgs::MarkerArray>("/reach_threshold_markers", 1);
-    waypoints_pub_ = nh_.advertise<cirkit_waypoint_manager_msgs::WaypointArray>("/waypoints", 1);
+    focus_sub_ = nh_.subscribe("focus_point", 1, &CirkitWaypointGenerator::focusPointCallback, this);
+    overview_pub_ = nh_.advertise<visualization_msgs::Marker>("/waypoint_overview", 1, true); // latch
+    // 変わったmarkerだけpublishする. 後から来たsubscriberには全部を1回だけ送る
+    reach_marker_pub_ = nh_.advertise<visualization_msgs::MarkerArray>(
+      "/reach_threshold_markers", 1,
+      boost::bind(&CirkitWaypointGenerator::reachMarkerConnectCallback, this, _1));
+    waypoints_pub_ = nh_.advertise<cirkit_waypoint_manager_msgs::WaypointArray>("/waypoints", 1, true); // latch
     waypoint_box_count_ = 0;
+    waypoints_dirty_ = false;
+    server_dirty_ = false;
     server.reset( new interactive_markers::InteractiveMarkerServer("cube") );
   }
 
   void load(std::string waypoint_file)
   {
-    const int rows_num = 9; // x, y, z, Qx, Qy, Qz, Qw, is_searching_area, reach_threshold
-    boost::char_separator<char> sep("," ,"", boost::keep_empty_tokens);
-    std::ifstream ifs(waypoint_file.c_str());
-    std::string line;
-    while(ifs.good()){
-      getline(ifs, line);
-      if(line.empty()){ break; }
-      tokenizer tokens(line, sep);
-      std::vector<double> data;
-      tokenizer::iterator it = tokens.begin();
-      for(; it != tokens.end() ; ++it){
-        std::stringstream ss;
-        double d;
-        ss << *it;
-        ss >> d;
-        data.push_back(d);
-      }
-      if(data.size() != rows_num){
-        ROS_ERROR("Row size is mismatch!!");
-        return;
-      }else{
-        geometry_msgs::PoseWithCovariance new_pose;
-        new_pose.pose.position.x = data[0];
-        new_pose.pose.position.y = data[1];
-        new_pose.pose.position.z = data[2];
-        new_pose.pose.orientation.x = data[3];
-        new_pose.pose.orientation.y = data[4];
-        new_pose.pose.orientation.z = data[5];
-        new_pose.pose.orientation.w = data[6];
-        makeWaypointMarker(new_pose, (int)data[7], data[8]);
-      }
+    cirkit_waypoint_io::WaypointFile records; // csv or binary(.wpb)
+    cirkit_waypoint_io::WaypointIoError error;
+    bool success = records.open(waypoint_file, &error);
+    if(!success){
+      ROS_ERROR_STREAM("Could not read waypoints : " << error.toString());
+      return;
+    }
+    // 全部作ってから1回だけapplyChanges()とpublishをする
+    size_t size = waypoints_.waypoints.size() + records.size();
+    waypoints_.waypoints.reserve(size);
+    reach_threshold_markers_.markers.reserve(size);
+    frame_names_.reserve(size);
+    interactive_.reserve(size);
+    marker_slots_.reserve(size);
+    for(size_t i = 0; i < records.size(); ++i){
+      geometry_msgs::PoseWithCovariance new_pose;
+      new_pose.pose.position.x = records[i].x;
+      new_pose.pose.position.y = records[i].y;
+      new_pose.pose.position.z = records[i].z;
+      new_pose.pose.orientation.x = records[i].qx;
+      new_pose.pose.orientation.y = records[i].qy;
+      new_pose.pose.orientation.z = records[i].qz;
+      new_pose.pose.orientation.w = records[i].qw;
+      makeWaypointMarker(new_pose, records[i].area_type, records[i].reach_threshold);
     }
+    updateLevelOfDetail();
+    publishChanges();
     ROS_INFO_STREAM(waypoint_box_count_ << "waypoints are loaded.");
   }
 
@@ -101,7 +136,7 @@ public:
     getRPY(new_pose.pose.orientation, roll, pitch, yaw);
     double last_yaw, last_pitch, last_roll;
     getRPY(last_pose_.pose.orientation, last_roll, last_pitch, last_yaw);
-    return fabs(yaw - last_yaw);
+    return fabs(RouteSimplifier::normalizeAngle(yaw - last_yaw)); // ±πをまたいでも差は小さい
   }
 
   InteractiveMarkerControl& makeWaypointMarkerControl(InteractiveMarker &msg,
@@ -145,32 +180,49 @@ public:
 
   void processFeedback( const visualization_msgs::InteractiveMarkerFeedbackConstPtr &feedback )
   {
-    std::ostringstream s;
-    s << "Feedback from marker '" << feedback->marker_name << "' "
-      << " / control '" << feedback->control_name << "'";
-  
     switch ( feedback->event_type )
     {
       case visualization_msgs::InteractiveMarkerFeedback::POSE_UPDATE:
         {
-          reach_threshold_markers_.markers[std::stoi(feedback->marker_name)].pose
-            = feedback->pose;
-          reach_marker_pub_.publish(reach_threshold_markers_);
-          waypoints_.waypoints[std::stoi(feedback->marker_name)].pose = feedback->pose;
+          // ドラッグ中は高い頻度で来るので, ここでは位置を書き換えるだけにして
+          // publishはpublishWaypointCallback()で周期ごとに1回にまとめる
+          std::unordered_map<std::string, int>::const_iterator slot = marker_slots_.find(feedback->marker_name);
+          if(slot == marker_slots_.end())
+          {
+            ROS_WARN_STREAM_THROTTLE(1.0, "Unknown marker : " << feedback->marker_name);
+            break;
+          }
+          int index = slot->second;
+          reach_threshold_markers_.markers[index].pose = feedback->pose;
+          waypoints_.waypoints[index].pose = feedback->pose;
+          markDirty(index);
           break;
         }
     }
-    server->applyChanges();
+    // interactive markerの位置はserverがfeedbackで更新しているのでapplyChanges()は要らない
   }
   
-  void makeWaypointMarker(const geometry_msgs::PoseWithCovariance new_pose,
-                          int is_searching_area, double reach_threshold)
+  // index番目のwaypointのinteractive markerをserverに入れる. 反映はapplyChanges()のとき
+  void insertInteractiveMarker(int index)
   {
+    const cirkit_waypoint_manager_msgs::Waypoint &waypoint = waypoints_.waypoints[index];
     InteractiveMarker int_marker;
     int_marker.header.frame_id = "map";
-    int_marker.pose = new_pose.pose;
+    int_marker.pose = waypoint.pose;
     int_marker.scale = 1;
+    int_marker.name = frame_names_[index];
+    int_marker.description = frame_names_[index];
+
+    makeWaypointMarkerControl(int_marker, waypoint.is_search_area);
+
+    server->insert(int_marker);
+    server->setCallback(int_marker.name, boost::bind(&CirkitWaypointGenerator::processFeedback, this, _1));
+    server_dirty_ = true;
+  }
 
+  void makeWaypointMarker(const geometry_msgs::PoseWithCovariance new_pose,
+                          int is_searching_area, double reach_threshold)
+  {
     visualization_msgs::Marker reach_marker;
     reach_marker.header.frame_id = "map";
     reach_marker.header.stamp = ros::Time();
@@ -186,18 +238,9 @@ public:
     reach_marker.color.g = 0.0;
     reach_marker.color.b = 1.0;
     reach_threshold_markers_.markers.push_back(reach_marker);
-    reach_marker_pub_.publish(reach_threshold_markers_);
     
     std::stringstream s;
     s << waypoint_box_count_;
-    int_marker.name = s.str();
-    int_marker.description = s.str();
-
-    makeWaypointMarkerControl(int_marker, is_searching_area);
-
-    server->insert(int_marker);
-    server->setCallback(int_marker.name, boost::bind(&CirkitWaypointGenerator::processFeedback, this, _1));
-    server->applyChanges();
 
     cirkit_waypoint_manager_msgs::Waypoint waypoint;
     waypoint.number = waypoint_box_count_;
@@ -205,19 +248,26 @@ public:
     waypoint.is_search_area = is_searching_area;
     waypoint.reach_tolerance = reach_threshold/2.0;
     waypoints_.waypoints.push_back(waypoint);
+    frame_names_.push_back(s.str()); // interactive markerとtfのframe名は作ったときに1回だけ作る
+    marker_slots_[s.str()] = waypoint_box_count_;
+    markDirty(waypoint_box_count_);
+    if(lod_radius_ > 0.0)
+    {
+      interactive_.push_back(false); // 次のupdateLevelOfDetail()で決める
+      lod_dirty_ = true;
+    }
+    else
+    {
+      interactive_.push_back(true);
+      insertInteractiveMarker(waypoint_box_count_);
+    }
     
     waypoint_box_count_++;
   }
 
   void addWaypoint(const geometry_msgs::PoseWithCovarianceStamped::ConstPtr& amcl_pose)
   {
-    double diff_dist = calculateDistance(amcl_pose->pose);
-    double diff_yaw = calculateAngle(amcl_pose->pose);
-    if(diff_dist > dist_th_ || diff_yaw > yaw_th_)
-    {
-      makeWaypointMarker(amcl_pose->pose, 0, 3.0);
-      last_pose_ = amcl_pose->pose;
-    }
+    addPose(amcl_pose->pose);
   }
 
   /*
@@ -229,20 +279,209 @@ public:
     
     geometry_msgs::PoseWithCovariance pose;
     pose.pose = ndt_pose->pose;
+    addPose(pose);
+  }
+
+  // 位置のcallbackではwaypointにするかどうかだけ決める.
+  // markerを作るのは重いのでpublishWaypointCallback()でまとめて行う
+  void addPose(const geometry_msgs::PoseWithCovariance &pose)
+  {
+    last_pose_time_ = ros::WallTime::now();
+    robot_pose_ = pose.pose;
+    has_robot_pose_ = true;
+    if(simplify_)
+    {
+      RoutePose route_pose;
+      route_pose.x = pose.pose.position.x;
+      route_pose.y = pose.pose.position.y;
+      route_pose.yaw = tf::getYaw(pose.pose.orientation);
+      simplifier_.add(route_pose, pending_waypoints_);
+      return;
+    }
     double diff_dist = calculateDistance(pose);
     double diff_yaw = calculateAngle(pose);
     if(diff_dist > dist_th_ || diff_yaw > yaw_th_)
     {
-      makeWaypointMarker(pose, 0, 3.0);
+      pending_poses_.push_back(pose); // z, roll, pitchも以前と同じく受け取ったまま使う
       last_pose_ = pose;
     }
   }
 
+  // 溜まったwaypointのmarkerを作る
+  void makePendingWaypointMarkers()
+  {
+    if(simplify_ && simplifier_.pending() > 0
+       && (ros::WallTime::now() - last_pose_time_).toSec() > flush_timeout_)
+    {
+      simplifier_.flush(pending_waypoints_); // 止まったら今の位置までを確定させる
+    }
+    for(size_t i = 0; i < pending_waypoints_.size(); ++i)
+    {
+      geometry_msgs::PoseWithCovariance pose;
+      pose.pose.position.x = pending_waypoints_[i].x;
+      pose.pose.position.y = pending_waypoints_[i].y;
+      pose.pose.orientation = tf::createQuaternionMsgFromYaw(pending_waypoints_[i].yaw);
+      makeWaypointMarker(pose, 0, 3.0);
+    }
+    pending_waypoints_.clear();
+    for(size_t i = 0; i < pending_poses_.size(); ++i)
+    {
+      makeWaypointMarker(pending_poses_[i], 0, 3.0);
+    }
+    pending_poses_.clear();
+  }
+
   void publishWaypointCallback(const ros::TimerEvent&)
   {
-    reach_marker_pub_.publish(reach_threshold_markers_);
-    waypoints_pub_.publish(waypoints_);
-    server->applyChanges();
+    makePendingWaypointMarkers();
+    updateLevelOfDetail();
+    publishChanges();
+  }
+
+  void focusPointCallback(const geometry_msgs::PointStamped &point)
+  {
+    focus_ = point.point;
+    has_focus_ = true;
+  }
+
+  // focus_pointが来ていればそこ, 無ければロボットの位置
+  bool getLevelOfDetailCenter(geometry_msgs::Point &center)
+  {
+    if(has_focus_)
+    {
+      center = focus_;
+      return true;
+    }
+    if(has_robot_pose_)
+    {
+      center = robot_pose_.position;
+      return true;
+    }
+    return false;
+  }
+
+  // 中心の近くだけinteractive markerにする. 中心がlod_radiusの1割以上動いたときか
+  // waypointが増えたときだけ作り直す
+  void updateLevelOfDetail()
+  {
+    if(lod_radius_ <= 0.0)
+    {
+      return;
+    }
+    geometry_msgs::Point center;
+    bool has_center = getLevelOfDetailCenter(center);
+    if(has_center && (!has_lod_center_
+                      || hypot(center.x - lod_center_.x, center.y - lod_center_.y) > lod_radius_ * 0.1))
+    {
+      lod_center_ = center;
+      has_lod_center_ = true;
+      lod_dirty_ = true;
+    }
+    if(!lod_dirty_)
+    {
+      return;
+    }
+    double radius_sq = lod_radius_ * lod_radius_;
+    visualization_msgs::Marker overview;
+    overview.header.frame_id = "map";
+    overview.ns = "waypoint_overview";
+    overview.id = 0;
+    overview.type = visualization_msgs::Marker::CUBE_LIST;
+    overview.action = visualization_msgs::Marker::ADD;
+    overview.pose.orientation.w = 1.0;
+    overview.scale.x = overview.scale.y = overview.scale.z = 0.5;
+    for(size_t i = 0; i < waypoints_.waypoints.size(); ++i)
+    {
+      const geometry_msgs::Point &position = waypoints_.waypoints[i].pose.position;
+      double dx = position.x - lod_center_.x;
+      double dy = position.y - lod_center_.y;
+      bool near = has_lod_center_ && dx*dx + dy*dy < radius_sq;
+      if(near && !interactive_[i])
+      {
+        insertInteractiveMarker(i);
+      }
+      else if(!near && interactive_[i])
+      {
+        server->erase(frame_names_[i]);
+        server_dirty_ = true;
+      }
+      interactive_[i] = near;
+      if(!near)
+      {
+        std_msgs::ColorRGBA color; // interactive markerの箱と同じ色
+        color.r = 0.05 + 1.0*(float)waypoints_.waypoints[i].is_search_area;
+        color.g = 0.80;
+        color.b = 0.02;
+        color.a = 1.0;
+        overview.points.push_back(position);
+        overview.colors.push_back(color);
+      }
+    }
+    if(overview.points.empty())
+    {
+      overview.action = visualization_msgs::Marker::DELETE;
+    }
+    overview_pub_.publish(overview);
+    lod_dirty_ = false;
+  }
+
+  // i番目のwaypointが追加された, または動いた
+  void markDirty(int index)
+  {
+    if((int)reach_marker_dirty_.size() <= index)
+    {
+      reach_marker_dirty_.resize(index + 1, false);
+    }
+    if(!reach_marker_dirty_[index])
+    {
+      reach_marker_dirty_[index] = true;
+      dirty_reach_markers_.push_back(index);
+    }
+    waypoints_dirty_ = true;
+  }
+
+  // 前回から変わったものだけ送る. 何も変わっていなければ何もしない
+  void publishChanges()
+  {
+    if(server_dirty_)
+    {
+      server->applyChanges();
+      server_dirty_ = false;
+    }
+    if(!dirty_reach_markers_.empty())
+    {
+      if(waypoint_frames_ == "all")
+      {
+        // 変わったframeだけ渡せば, broadcasterがこれまでのものとまとめて1つのmsgで送る
+        std::vector<geometry_msgs::TransformStamped> transforms;
+        transforms.reserve(dirty_reach_markers_.size());
+        ros::Time now = ros::Time::now();
+        for(size_t i = 0; i < dirty_reach_markers_.size(); ++i)
+        {
+          transforms.push_back(makeWaypointTransform(dirty_reach_markers_[i], now));
+        }
+        static_br_.sendTransform(transforms);
+      }
+      visualization_msgs::MarkerArray delta;
+      delta.markers.reserve(dirty_reach_markers_.size());
+      for(size_t i = 0; i < dirty_reach_markers_.size(); ++i)
+      {
+        delta.markers.push_back(reach_threshold_markers_.markers[dirty_reach_markers_[i]]);
+        reach_marker_dirty_[dirty_reach_markers_[i]] = false;
+      }
+      dirty_reach_markers_.clear();
+      reach_marker_pub_.publish(delta);
+    }
+    if(waypoints_dirty_)
+    {
+      waypoints_pub_.publish(waypoints_); // latchなので変わったときだけでよい
+      waypoints_dirty_ = false;
+    }
+  }
+
+  void reachMarkerConnectCallback(const ros::SingleSubscriberPublisher &pub)
+  {
+    pub.publish(reach_threshold_markers_);
   }
 
   void clickedPointCallback(const geometry_msgs::PointStamped &point)
@@ -251,32 +490,52 @@ public:
     tf::pointTFToMsg(tf::Vector3( point.point.x, point.point.y, 0), pose.pose.position);
     tf::quaternionTFToMsg(tf::createQuaternionFromRPY(0, 0, 0), pose.pose.orientation);
     makeWaypointMarker(pose, 0, 3.0);
-    server->applyChanges();
   }
   
-  void tfSendTransformCallback(const ros::TimerEvent&)
-  {  
-    tf::Transform t;
-    ros::Time time = ros::Time::now();
+  geometry_msgs::TransformStamped makeWaypointTransform(int index, const ros::Time &stamp)
+  {
+    const geometry_msgs::Pose &pose = waypoints_.waypoints[index].pose;
+    geometry_msgs::TransformStamped transform;
+    transform.header.stamp = stamp;
+    transform.header.frame_id = "map";
+    transform.child_frame_id = frame_names_[index];
+    transform.transform.translation.x = pose.position.x;
+    transform.transform.translation.y = pose.position.y;
+    transform.transform.translation.z = pose.position.z;
+    transform.transform.rotation = pose.orientation;
+    return transform;
+  }
 
+  // waypoint_frames:=windowのとき. ロボットの近くのframeだけを1つのmsgで送る
+  void tfSendTransformCallback(const ros::TimerEvent&)
+  {
+    if(!has_robot_pose_)
+    {
+      return;
+    }
+    ros::Time now = ros::Time::now();
+    double radius_sq = waypoint_frame_radius_ * waypoint_frame_radius_;
+    std::vector<geometry_msgs::TransformStamped> transforms;
     for (size_t i = 0; i < waypoints_.waypoints.size(); ++i) {
-      std::stringstream s;
-      s << waypoints_.waypoints[i].number;
-      t.setOrigin(tf::Vector3(waypoints_.waypoints[i].pose.position.x,
-                              waypoints_.waypoints[i].pose.position.y,
-                              waypoints_.waypoints[i].pose.position.z));
-      t.setRotation(tf::Quaternion(waypoints_.waypoints[i].pose.orientation.x,
-                                   waypoints_.waypoints[i].pose.orientation.y,
-                                   waypoints_.waypoints[i].pose.orientation.z,
-                                   waypoints_.waypoints[i].pose.orientation.w));
-      br_.sendTransform(tf::StampedTransform(t, time, "map", s.str()));
+      double dx = waypoints_.waypoints[i].pose.position.x - robot_pose_.position.x;
+      double dy = waypoints_.waypoints[i].pose.position.y - robot_pose_.position.y;
+      if (dx*dx + dy*dy < radius_sq) {
+        transforms.push_back(makeWaypointTransform(i, now));
+      }
+    }
+    if (!transforms.empty()) {
+      br_.sendTransform(transforms);
     }
   }
   
   void run()
   {
-    ros::Timer frame_timer = nh_.createTimer(ros::Duration(0.1), boost::bind(&CirkitWaypointGenerator::publishWaypointCallback, this, _1));
-    ros::Timer tf_frame_timer = nh_.createTimer(ros::Duration(0.1), boost::bind(&CirkitWaypointGenerator::tfSendTransformCallback, this, _1));
+    ros::Timer frame_timer = nh_.createTimer(ros::Duration(publish_period_), boost::bind(&CirkitWaypointGenerator::publishWaypointCallback, this, _1));
+    ros::Timer tf_frame_timer;
+    if(waypoint_frames_ == "window")
+    {
+      tf_frame_timer = nh_.createTimer(ros::Duration(waypoint_frame_period_), boost::bind(&CirkitWaypointGenerator::tfSendTransformCallback, this, _1));
+    }
     while(ros::ok())
     {
       ros::spinOnce();
@@ -295,10 +554,38 @@ private:
   cirkit_waypoint_manager_msgs::WaypointArray waypoints_;
   double dist_th_;
   double yaw_th_;
+  bool simplify_;
+  RouteSimplifier simplifier_;
+  std::vector<RoutePose> pending_waypoints_; // waypointにすると決まったがmarkerをまだ作っていない位置
+  std::vector<geometry_msgs::PoseWithCovariance> pending_poses_; // simplify:=falseのときの同じもの
+  double flush_timeout_;
+  ros::WallTime last_pose_time_;
   int waypoint_box_count_;
   std::vector<double> reach_thresholds_;
   visualization_msgs::MarkerArray reach_threshold_markers_;
-  tf::TransformBroadcaster br_;
+  std::vector<bool> reach_marker_dirty_;  // 次のpublishで送るreach marker
+  std::vector<int> dirty_reach_markers_;
+  bool waypoints_dirty_;                  // waypoints_が前回のpublishから変わった
+  bool server_dirty_;                     // interactive markerを追加した
+  tf2_ros::TransformBroadcaster br_;
+  tf2_ros::StaticTransformBroadcaster static_br_;
+  std::vector<std::string> frame_names_;  // waypointのtf frame名
+  std::unordered_map<std::string, int> marker_slots_; // interactive marker名 -> waypoints_のindex
+  double publish_period_;
+  double lod_radius_;
+  std::vector<bool> interactive_;         // interactive markerをserverに入れているか
+  bool lod_dirty_;
+  geometry_msgs::Point lod_center_;       // 今のinteractive markerを選んだ中心
+  bool has_lod_center_;
+  geometry_msgs::Point focus_;
+  bool has_focus_;
+  ros::Subscriber focus_sub_;
+  ros::Publisher overview_pub_;
+  std::string waypoint_frames_;
+  double waypoint_frame_radius_;
+  double waypoint_frame_period_;
+  geometry_msgs::Pose robot_pose_;        // 最後に受け取ったロボットの位置
+  bool has_robot_pose_;
 };
 
 
@@ -311,7 +598,7 @@ int main(int argc, char** argv)
   boost::program_options::options_description desc("Options");
   desc.add_options()
     ("help", "Print help message")
-    ("load", boost::program_options::value<std::string>(), "waypoint filename");
+    ("load", boost::program_options::value<std::string>(), "waypoint filename (csv or binary)");
 
   boost::program_options::variables_map vm;
   try {
@@ -1,30 +1,12 @@
 #include <ros/ros.h>
-#include <geometry_msgs/PoseWithCovarianceStamped.h>
-#include <interactive_markers/interactive_marker_server.h>
-#include <interactive_markers/menu_handler.h>
-#include <nav_msgs/Odometry.h>
-#include <tf/tf.h>
-#include <tf/transform_broadcaster.h>
-#include <visualization_msgs/InteractiveMarkerInit.h>
-#include <visualization_msgs/MarkerArray.h>
+#include <cirkit_waypoint_io/waypoint_journal.h>
 #include <cirkit_waypoint_manager_msgs/WaypointArray.h>
 
-#include <fstream>
-#include <iostream>
-#include <math.h>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include <boost/date_time.hpp>
-#include <boost/program_options.hpp>
-#include <boost/shared_array.hpp>
-#include <boost/tokenizer.hpp>
-
-bool compareInteractiveMarker(visualization_msgs::InteractiveMarker left,
-                              visualization_msgs::InteractiveMarker right)
-{
-  return std::stoi(left.name) < std::stoi(right.name);
-}
 
 std::string timeToStr()
 {
@@ -38,57 +20,118 @@ std::string timeToStr()
     return msg.str();
 }
 
+// /waypointsを受け取るたびに変わった行だけjournalに追記し, 定期的にcsvへsnapshotする.
+// 途中で落ちても同じfileで起動し直せば, snapshotとjournalから復元して続きを保存する.
 class CirkitWaypointSaver
 {
 public:
-  CirkitWaypointSaver(const std::string& waypoints_file):
-    waypoints_file_(waypoints_file), saved_waypoints_(false)
+  CirkitWaypointSaver():
+    journal_sync_(true)
   {
     ros::NodeHandle n;
-    
+    ros::NodeHandle private_nh("~");
+    std::string waypoints_file;
+    double snapshot_period;
+    private_nh.param("file", waypoints_file, timeToStr() + ".csv");
+    private_nh.param("snapshot_period", snapshot_period, 10.0);
+    private_nh.param("journal_sync", journal_sync_, true);
+
+    cirkit_waypoint_io::WaypointIoError error;
+    if(!journal_.open(waypoints_file, &error))
+    {
+      ROS_FATAL_STREAM("Could not open " << error.toString());
+      ros::shutdown();
+      return;
+    }
+    if(journal_.replayedEntries() > 0)
+    {
+      ROS_WARN_STREAM("Recovered " << journal_.waypoints().size() << " waypoints ("
+                      << journal_.replayedEntries() << " journal entries) into " << waypoints_file);
+    }
+    else if(!journal_.waypoints().empty())
+    {
+      ROS_INFO_STREAM("Resuming " << waypoints_file << " with " << journal_.waypoints().size() << " waypoints");
+    }
+
     waypoints_sub_ = n.subscribe("/waypoints", 1, &CirkitWaypointSaver::waypointsCallback, this);
-    ROS_INFO("Waiting for waypoints");
+    snapshot_timer_ = n.createTimer(ros::Duration(snapshot_period), &CirkitWaypointSaver::snapshotCallback, this);
+    ROS_INFO_STREAM("Saving waypoints to : " << waypoints_file);
+  }
+
+  ~CirkitWaypointSaver()
+  {
+    if(!journal_.dirty())
+    {
+      return;
+    }
+    cirkit_waypoint_io::WaypointIoError error;
+    if(journal_.close(&error))
+    {
+      ROS_INFO_STREAM("Saved " << journal_.waypoints().size() << " waypoints to : " << journal_.filename());
+    }
+    else
+    {
+      ROS_ERROR_STREAM("Could not save " << error.toString());
+    }
   }
 
-  void waypointsCallback(cirkit_waypoint_manager_msgs::WaypointArray waypoints)
+  void waypointsCallback(const cirkit_waypoint_manager_msgs::WaypointArray::ConstPtr &waypoints)
   {
-    ROS_INFO("Received waypoints : %d", (int)waypoints.waypoints.size());
+    size_t size = waypoints->waypoints.size();
+    records_.resize(size);
+    for(size_t i = 0; i < size; i++)
+    {
+      const cirkit_waypoint_manager_msgs::Waypoint &w = waypoints->waypoints[i];
+      cirkit_waypoint_io::WaypointRecord &r = records_[i];
+      r.x = w.pose.position.x;
+      r.y = w.pose.position.y;
+      r.z = 0;
+      r.qx = w.pose.orientation.x;
+      r.qy = w.pose.orientation.y;
+      r.qz = w.pose.orientation.z;
+      r.qw = w.pose.orientation.w;
+      r.reach_threshold = w.reach_tolerance * 2.0;
+      r.area_type = w.is_search_area;
+      r.reserved = 0;
+    }
+    cirkit_waypoint_io::WaypointIoError error;
+    if(!journal_.update(records_.data(), size, journal_sync_, &error))
+    {
+      ROS_ERROR_STREAM_THROTTLE(5.0, "Could not write " << error.toString());
+    }
+  }
 
-    std::ofstream savefile(waypoints_file_.c_str(), std::ios::out);
-    //std::sort(all_markers.markers.begin(), all_markers.markers.end(), compareInteractiveMarker);
-    size_t size = waypoints.waypoints.size();
-    for(unsigned int i = 0; i < size; i++){
-      //３次元の位置の指定
-      savefile << waypoints.waypoints[i].pose.position.x << ","
-               << waypoints.waypoints[i].pose.position.y << ","
-               << 0 << ","
-               << waypoints.waypoints[i].pose.orientation.x << ","
-               << waypoints.waypoints[i].pose.orientation.y << ","
-               << waypoints.waypoints[i].pose.orientation.z << ","
-               << waypoints.waypoints[i].pose.orientation.w << ","
-               << waypoints.waypoints[i].is_search_area << ","
-               << waypoints.waypoints[i].reach_tolerance * 2.0 << std::endl;
-      ROS_INFO_STREAM("Num: " << waypoints.waypoints[i].number);
+  void snapshotCallback(const ros::TimerEvent &)
+  {
+    if(!journal_.dirty())
+    {
+      return;
+    }
+    size_t entries = journal_.journalEntries();
+    cirkit_waypoint_io::WaypointIoError error;
+    if(journal_.snapshot(&error))
+    {
+      ROS_INFO("Saved %d waypoints (%d changes)", (int)journal_.waypoints().size(), (int)entries);
+    }
+    else
+    {
+      ROS_ERROR_STREAM_THROTTLE(5.0, "Could not save " << error.toString());
     }
-    saved_waypoints_ = true;
-    ROS_INFO_STREAM("Saved to : " << waypoints_file_);
   }
-  
-  std::string waypoints_file_;
+
+private:
+  cirkit_waypoint_io::WaypointJournal journal_;
+  std::vector<cirkit_waypoint_io::WaypointRecord> records_;
+  bool journal_sync_;
   ros::Subscriber waypoints_sub_;
-  bool saved_waypoints_;
+  ros::Timer snapshot_timer_;
 };
 
 int main(int argc, char** argv)
 {
   ros::init(argc, argv, "waypoint_saver");
-  std::string waypoints_name = timeToStr() + ".csv";
-  
-  CirkitWaypointSaver saver(waypoints_name);
-  while(!saver.saved_waypoints_ && ros::ok())
-  {
-    ros::spinOnce();
-  }
-  
+  CirkitWaypointSaver saver;
+  ros::spin();
+
   return 0;
 }
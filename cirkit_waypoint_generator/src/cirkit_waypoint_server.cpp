@@ -6,23 +6,21 @@
 #include <tf/tf.h>
 #include <tf/transform_broadcaster.h>
 #include <visualization_msgs/MarkerArray.h>
+#include <cirkit_waypoint_io/waypoint_binary.h>
 
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <math.h>
 #include <sstream>
 #include <string>
 
 #include <boost/program_options.hpp>
 #include <boost/shared_array.hpp>
-#include <boost/tokenizer.hpp>
 
 using namespace visualization_msgs;
 
 
-typedef boost::tokenizer<boost::char_separator<char> > tokenizer;
-
-
 class CirkitWaypointServer
 {
 public:
@@ -30,49 +28,60 @@ public:
     rate_(5)
   {
     ros::NodeHandle n("~");
-    waypoint_marker_pub_ = nh_.advertise<visualization_msgs::MarkerArray>("/waypoint_markers", 1);
-    waypoint_number_pub_ = nh_.advertise<visualization_msgs::MarkerArray>("/waypoint_numbers", 1);
+    // true : 矢印をarea typeごとに1つのLINE_LIST/POINTSのmarkerにまとめる
+    n.param("compact", compact_, false);
+    n.param("show_labels", show_labels_, true); // false : 番号のmarkerを出さない
+    // loadしたときに1回だけpublishする(latch)
+    waypoint_marker_pub_ = nh_.advertise<visualization_msgs::MarkerArray>("/waypoint_markers", 1, true);
+    waypoint_number_pub_ = nh_.advertise<visualization_msgs::MarkerArray>("/waypoint_numbers", 1, true);
   }
 
   void load(std::string waypoint_file)
   {
-    const int rows_num = 9; // x, y, z, Qx, Qy, Qz, Qw, is_searching_area, reach_threshold
-    boost::char_separator<char> sep("," ,"", boost::keep_empty_tokens);
-    std::ifstream ifs(waypoint_file.c_str());
-    std::string line;
+    cirkit_waypoint_io::WaypointFile records; // csv or binary(.wpb)
+    cirkit_waypoint_io::WaypointIoError error;
+    bool success = records.open(waypoint_file, &error);
+    if(!success){
+      ROS_ERROR_STREAM("Could not read waypoints : " << error.toString());
+      return;
+    }
     int num = 1;
     waypoint_box_count_ = 0;
     waypoint_text_count_ = 0;
-    while(ifs.good()){
-      getline(ifs, line);
-      if(line.empty()){ break; }
-      tokenizer tokens(line, sep);
-      std::vector<double> data;
-      tokenizer::iterator it = tokens.begin();
-      for(; it != tokens.end() ; ++it){
-        std::stringstream ss;
-        double d;
-        ss << *it;
-        ss >> d;
-        data.push_back(d);
-      }
-      if(data.size() != rows_num){
-        ROS_ERROR("Row size is mismatch!!");
-        return;
+    waypoint_arrow_markers_.markers.clear();
+    waypoint_num_markers.markers.clear();
+    compact_markers_.clear();
+    if(!compact_){
+      waypoint_arrow_markers_.markers.reserve(records.size());
+    }
+    if(show_labels_){
+      waypoint_num_markers.markers.reserve(records.size());
+    }
+    // 全部作ってから1回だけpublishする
+    for(size_t i = 0; i < records.size(); ++i){
+      geometry_msgs::PoseWithCovariance new_pose;
+      new_pose.pose.position.x = records[i].x;
+      new_pose.pose.position.y = records[i].y;
+      new_pose.pose.position.z = records[i].z;
+      new_pose.pose.orientation.x = records[i].qx;
+      new_pose.pose.orientation.y = records[i].qy;
+      new_pose.pose.orientation.z = records[i].qz;
+      new_pose.pose.orientation.w = records[i].qw;
+      if(compact_){
+        addCompactWaypoint(new_pose, records[i].area_type);
       }else{
-        geometry_msgs::PoseWithCovariance new_pose;
-        new_pose.pose.position.x = data[0];
-        new_pose.pose.position.y = data[1];
-        new_pose.pose.position.z = data[2];
-        new_pose.pose.orientation.x = data[3];
-        new_pose.pose.orientation.y = data[4];
-        new_pose.pose.orientation.z = data[5];
-        new_pose.pose.orientation.w = data[6];
-        makeWaypointMarker(new_pose, (int)data[7], data[8]);
-        makeWaypointNumber(new_pose, (int)data[7], num ++);
+        makeWaypointMarker(new_pose, records[i].area_type, records[i].reach_threshold);
+      }
+      if(show_labels_){
+        makeWaypointNumber(new_pose, records[i].area_type, num);
       }
+      num++;
     }
     ROS_INFO_STREAM(waypoint_box_count_ << "waypoints are loaded.");
+    waypoint_marker_pub_.publish(waypoint_arrow_markers_);
+    if(show_labels_){
+      waypoint_number_pub_.publish(waypoint_num_markers);
+    }
   }
 
 
@@ -104,7 +113,6 @@ public:
     waypoint_marker.color.b = b;
     waypoint_marker.text = std::to_string(number);
     waypoint_num_markers.markers.push_back(waypoint_marker);
-    waypoint_number_pub_.publish(waypoint_num_markers);
     waypoint_text_count_++;
   }
 
@@ -130,14 +138,48 @@ public:
     waypoint_marker.color.g = g;
     waypoint_marker.color.b = b;
     waypoint_arrow_markers_.markers.push_back(waypoint_marker);
-    waypoint_marker_pub_.publish(waypoint_arrow_markers_);
     waypoint_box_count_++;
   }
 
-  void publishWaypointCallback(const ros::TimerEvent&)
+  // compactのとき. area typeごとに, 向きの線分をLINE_LIST(id 2*area_type)に,
+  // 位置をPOINTS(id 2*area_type+1)に足していく
+  void addCompactWaypoint(const geometry_msgs::PoseWithCovariance new_pose, int area_type)
   {
-    waypoint_marker_pub_.publish(waypoint_arrow_markers_);
-    waypoint_number_pub_.publish(waypoint_num_markers);
+    std::map<int, size_t>::iterator it = compact_markers_.find(area_type);
+    if(it == compact_markers_.end()){
+      double r, g, b;
+      getColor(area_type, r, g, b);
+      visualization_msgs::Marker marker;
+      marker.header.frame_id = "map";
+      marker.header.stamp = ros::Time();
+      marker.ns = "waypoints";
+      marker.action = visualization_msgs::Marker::ADD;
+      marker.pose.orientation.w = 1.0;
+      marker.color.a = 0.7;
+      marker.color.r = r;
+      marker.color.g = g;
+      marker.color.b = b;
+      marker.id = 2*area_type;
+      marker.type = visualization_msgs::Marker::LINE_LIST;
+      marker.scale.x = 0.1; // 線の太さ
+      waypoint_arrow_markers_.markers.push_back(marker);
+      marker.id = 2*area_type + 1;
+      marker.type = visualization_msgs::Marker::POINTS;
+      marker.scale.x = 0.3;
+      marker.scale.y = 0.3;
+      waypoint_arrow_markers_.markers.push_back(marker);
+      it = compact_markers_.insert(std::make_pair(area_type, waypoint_arrow_markers_.markers.size() - 2)).first;
+    }
+    const geometry_msgs::Point &position = new_pose.pose.position;
+    double yaw = tf::getYaw(new_pose.pose.orientation);
+    geometry_msgs::Point head = position;
+    head.x += 0.8*cos(yaw); // 矢印と同じ長さ
+    head.y += 0.8*sin(yaw);
+    visualization_msgs::Marker &lines = waypoint_arrow_markers_.markers[it->second];
+    lines.points.push_back(position);
+    lines.points.push_back(head);
+    waypoint_arrow_markers_.markers[it->second + 1].points.push_back(position);
+    waypoint_box_count_++;
   }
 
   void getColor(int area_type, double& r, double& g, double& b)
@@ -179,8 +221,7 @@ public:
   
   void run()
   {
-    ros::Timer frame_timer = nh_.createTimer(ros::Duration(0.1), boost::bind(&CirkitWaypointServer::publishWaypointCallback, this, _1));
-   
+    // markerはlatchしてあるので周期的には送らない
     while(ros::ok())
     {
       ros::spinOnce();
@@ -195,6 +236,9 @@ private:
   ros::Publisher waypoint_number_pub_;
   int waypoint_box_count_;
   int waypoint_text_count_;
+  bool compact_;
+  bool show_labels_;
+  std::map<int, size_t> compact_markers_; // area type -> waypoint_arrow_markers_のLINE_LISTのindex
   visualization_msgs::MarkerArray waypoint_arrow_markers_;
   visualization_msgs::MarkerArray waypoint_num_markers;
 };
@@ -209,7 +253,7 @@ int main(int argc, char** argv)
   boost::program_options::options_description desc("Options");
   desc.add_options()
     ("help", "Print help message")
-    ("load", boost::program_options::value<std::string>(), "waypoint filename");
+    ("load", boost::program_options::value<std::string>(), "waypoint filename (csv or binary)");
 
   boost::program_options::variables_map vm;
   try {
@@ -0,0 +1,66 @@
+#ifndef CIRKIT_WAYPOINT_IO_COMPILED_ROUTE_H_
+#define CIRKIT_WAYPOINT_IO_COMPILED_ROUTE_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "cirkit_waypoint_io/waypoint_csv.h"
+
+namespace cirkit_waypoint_io {
+
+/**
+ * Route compiled once at load time, stored as structure-of-arrays.
+ * Segment i goes from waypoint i to waypoint i+1. For the last waypoint
+ * segment_length is 0 and the heading/direction of the previous segment is kept.
+ * reach_threshold is the radius [m], i.e. half of the value in the file.
+ */
+class CompiledRoute {
+public:
+  void compile(const WaypointRecord *waypoints, size_t size);
+  void clear();
+
+  size_t size() const { return x_.size(); }
+  bool empty() const { return x_.empty(); }
+
+  double x(size_t i) const { return x_[i]; }
+  double y(size_t i) const { return y_[i]; }
+  double yaw(size_t i) const { return yaw_[i]; }
+  int areaType(size_t i) const { return area_type_[i]; }
+  double reachThreshold(size_t i) const { return reach_threshold_[i]; }
+
+  double segmentLength(size_t i) const { return segment_length_[i]; }
+  double heading(size_t i) const { return heading_[i]; }
+  double directionX(size_t i) const { return direction_x_[i]; }
+  double directionY(size_t i) const { return direction_y_[i]; }
+  // arc length from the first waypoint to waypoint i
+  double arcLength(size_t i) const { return arc_length_[i]; }
+  double totalLength() const { return arc_length_.empty() ? 0.0 : arc_length_.back(); }
+
+  double distanceSquared(size_t i, double x, double y) const {
+    double dx = x - x_[i];
+    double dy = y - y_[i];
+    return dx*dx + dy*dy;
+  }
+  bool isReached(size_t i, double x, double y) const {
+    return distanceSquared(i, x, y) < reach_threshold_[i] * reach_threshold_[i];
+  }
+
+  const double* xData() const { return x_.data(); }
+  const double* yData() const { return y_.data(); }
+
+private:
+  std::vector<double> x_;
+  std::vector<double> y_;
+  std::vector<double> yaw_;
+  std::vector<int> area_type_;
+  std::vector<double> reach_threshold_;
+  std::vector<double> segment_length_;
+  std::vector<double> heading_;
+  std::vector<double> direction_x_;
+  std::vector<double> direction_y_;
+  std::vector<double> arc_length_;
+};
+
+} // namespace cirkit_waypoint_io
+
+#endif
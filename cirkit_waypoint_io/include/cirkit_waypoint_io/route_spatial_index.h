@@ -0,0 +1,72 @@
+#ifndef CIRKIT_WAYPOINT_IO_ROUTE_SPATIAL_INDEX_H_
+#define CIRKIT_WAYPOINT_IO_ROUTE_SPATIAL_INDEX_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "cirkit_waypoint_io/compiled_route.h"
+
+namespace cirkit_waypoint_io {
+
+/**
+ * 2D k-d tree over the waypoints of a CompiledRoute.
+ * The route must outlive the index and must not be recompiled without build().
+ */
+class RouteSpatialIndex {
+public:
+  static const size_t kMaxNeighbors = 32;
+
+  RouteSpatialIndex();
+
+  void build(const CompiledRoute &route);
+  void clear();
+  size_t size() const { return nodes_.size(); }
+
+  /**
+   * k nearest waypoints to (x, y), nearest first.
+   * Returns the number found (<= k, k is clamped to kMaxNeighbors).
+   */
+  size_t nearest(double x, double y, size_t k,
+                 int *indices, double *distances_sq) const;
+
+  /**
+   * Waypoint minimizing distance + heading_weight * |heading - segment heading|
+   * among the nearest candidates, so a course passing the same place twice
+   * resolves to the pass going in the robot's direction. -1 if empty.
+   */
+  int nearestWaypoint(double x, double y, double heading,
+                      double heading_weight = 1.0) const;
+
+  /**
+   * Index of the waypoint to go next from (x, y, heading):
+   * the nearest waypoint, or the one after it if the robot is already past it.
+   * Returns route size if the robot is past the final waypoint, -1 if empty.
+   */
+  int resumeWaypoint(double x, double y, double heading,
+                     double heading_weight = 1.0) const;
+
+private:
+  struct Node {
+    double x;
+    double y;
+    int index;
+  };
+
+  struct Neighbors {
+    size_t k;
+    size_t count;
+    int indices[kMaxNeighbors];
+    double distances_sq[kMaxNeighbors];
+  };
+
+  void buildRecursive(size_t begin, size_t end, int depth);
+  void search(size_t begin, size_t end, int depth,
+              double x, double y, Neighbors &neighbors) const;
+
+  const CompiledRoute *route_;
+  std::vector<Node> nodes_; // implicit tree: node of [begin, end) is at the middle
+};
+
+} // namespace cirkit_waypoint_io
+
+#endif
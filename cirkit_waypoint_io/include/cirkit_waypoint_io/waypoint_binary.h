@@ -0,0 +1,86 @@
+#ifndef CIRKIT_WAYPOINT_IO_WAYPOINT_BINARY_H_
+#define CIRKIT_WAYPOINT_IO_WAYPOINT_BINARY_H_
+
+#include <stdint.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "cirkit_waypoint_io/waypoint_csv.h"
+
+namespace cirkit_waypoint_io {
+
+/**
+ * Binary route format (*.wpb)
+ *   WaypointBinaryHeader (32 bytes)
+ *   WaypointRecord * count (72 bytes each, host byte order)
+ * Records can be used straight from mmap() without parsing.
+ */
+const char kWaypointBinaryMagic[8] = {'C', 'W', 'P', 'R', 'O', 'U', 'T', 'E'};
+const uint32_t kWaypointBinaryVersion = 1;
+const uint32_t kWaypointBinaryByteOrder = 0x01020304;
+const char kWaypointBinaryExtension[] = ".wpb";
+
+struct WaypointBinaryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t count;
+  uint32_t byte_order;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(WaypointRecord) == 72, "WaypointRecord is the on-disk record");
+static_assert(sizeof(WaypointBinaryHeader) == 32, "WaypointBinaryHeader is the on-disk header");
+
+enum WaypointFileFormat {
+  WAYPOINT_FILE_UNKNOWN,
+  WAYPOINT_FILE_CSV,
+  WAYPOINT_FILE_BINARY
+};
+
+// Binary if the file starts with the magic bytes or has the .wpb extension, CSV otherwise.
+WaypointFileFormat detectWaypointFileFormat(const std::string &filename);
+
+bool writeWaypointBinary(const std::string &filename,
+                         const WaypointRecord *waypoints, size_t size,
+                         WaypointIoError *error = NULL);
+
+/**
+ * Read-only waypoint list opened from either format.
+ * Binary files are mmap()ed and records point into the mapping.
+ * CSV files are parsed into an owned buffer.
+ */
+class WaypointFile {
+public:
+  WaypointFile();
+  ~WaypointFile();
+  WaypointFile(const WaypointFile&) = delete;
+  WaypointFile& operator=(const WaypointFile&) = delete;
+
+  bool open(const std::string &filename, WaypointIoError *error = NULL);
+  void close();
+
+  WaypointFileFormat format() const { return format_; }
+  const WaypointRecord* data() const { return records_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const WaypointRecord& operator[](size_t i) const { return records_[i]; }
+  const WaypointRecord* begin() const { return records_; }
+  const WaypointRecord* end() const { return records_ + size_; }
+
+private:
+  bool mapBinary(const std::string &filename, WaypointIoError *error);
+
+  WaypointFileFormat format_;
+  const WaypointRecord *records_;
+  size_t size_;
+  void *mapped_;
+  size_t mapped_length_;
+  std::vector<WaypointRecord> parsed_;
+};
+
+} // namespace cirkit_waypoint_io
+
+#endif
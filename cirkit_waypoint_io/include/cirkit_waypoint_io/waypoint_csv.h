@@ -0,0 +1,68 @@
+#ifndef CIRKIT_WAYPOINT_IO_WAYPOINT_CSV_H_
+#define CIRKIT_WAYPOINT_IO_WAYPOINT_CSV_H_
+
+#include <stdint.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace cirkit_waypoint_io {
+
+// x, y, z, qx, qy, qz, qw, area_type, reach_threshold
+const size_t kWaypointCsvColumns = 9;
+
+// CSVの1行分. reach_thresholdはファイルに書かれた値そのまま(各ノードで/2.0する)
+// This is also the on-disk record of the binary format (waypoint_binary.h),
+// so the layout must not change without bumping kWaypointBinaryVersion.
+struct WaypointRecord {
+  double x;
+  double y;
+  double z;
+  double qx;
+  double qy;
+  double qz;
+  double qw;
+  double reach_threshold;
+  int32_t area_type;
+  uint32_t reserved;
+};
+
+struct WaypointIoError {
+  WaypointIoError() : line(0), column(0) {}
+  std::string toString() const;
+
+  std::string filename;
+  size_t line;   // 1-origin, 0 if not related to a line
+  size_t column; // 1-origin, 0 if not related to a column
+  std::string message;
+};
+
+/**
+ * Parse waypoint CSV text in a single pass without per-field allocation.
+ * - Blank lines and lines starting with '#' are skipped.
+ * - Text after '#' in a data line is a trailing comment.
+ * - The first data line is treated as a header if it does not start with a number.
+ * - CRLF line endings and blanks around fields are accepted.
+ * On error, returns false and reports the line/column in error (if not NULL).
+ * Records already parsed stay in waypoints.
+ */
+bool parseWaypointCsv(const char *data, size_t size,
+                      std::vector<WaypointRecord> &waypoints,
+                      WaypointIoError *error = NULL);
+
+// Read the whole file at once and parse it with parseWaypointCsv().
+bool readWaypointCsv(const std::string &filename,
+                     std::vector<WaypointRecord> &waypoints,
+                     WaypointIoError *error = NULL);
+
+// Write waypoints as CSV. Numbers are written in the shortest form that reads back exactly.
+// A non-empty comment is written as a '#' line before the rows.
+bool writeWaypointCsv(const std::string &filename,
+                      const WaypointRecord *waypoints, size_t size,
+                      WaypointIoError *error = NULL,
+                      const std::string &comment = std::string());
+
+} // namespace cirkit_waypoint_io
+
+#endif
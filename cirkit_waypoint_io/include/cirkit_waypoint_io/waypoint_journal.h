@@ -0,0 +1,76 @@
+#ifndef CIRKIT_WAYPOINT_IO_WAYPOINT_JOURNAL_H_
+#define CIRKIT_WAYPOINT_IO_WAYPOINT_JOURNAL_H_
+
+#include <stdio.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "cirkit_waypoint_io/waypoint_csv.h"
+
+namespace cirkit_waypoint_io {
+
+/**
+ * Crash-safe waypoint CSV kept up to date while a route is recorded.
+ *   <file>          last snapshot, a waypoint CSV starting with "# journal generation <n>"
+ *   <file>.journal  "G,<n>", then the changes since snapshot n, one line each:
+ *                     W,<index>,x,y,z,qx,qy,qz,qw,area_type,reach_threshold
+ *                     N,<size>
+ * update() appends only the rows that changed; snapshot() writes
+ * <file>.tmp as generation n+1, renames it over <file> and then starts an
+ * empty journal for n+1.
+ * open() loads the snapshot and replays the journal up to the first
+ * incomplete line, so a crash loses at most the line being written.
+ * A journal of another generation is already contained in the snapshot
+ * (crash between the rename and the new journal) and is ignored.
+ */
+class WaypointJournal {
+public:
+  WaypointJournal();
+  ~WaypointJournal();
+  WaypointJournal(const WaypointJournal&) = delete;
+  WaypointJournal& operator=(const WaypointJournal&) = delete;
+
+  // Load <file> and <file>.journal if they exist, then open the journal for appending.
+  bool open(const std::string &filename, WaypointIoError *error = NULL);
+  // Final snapshot(), then close and remove the empty journal.
+  bool close(WaypointIoError *error = NULL);
+
+  /**
+   * Make the route equal to waypoints, journaling the differences.
+   * With sync, the journal is fdatasync()ed before returning.
+   * Returns false if the journal could not be written; the route is then
+   * left as it was, and the next update() writes a full snapshot instead.
+   */
+  bool update(const WaypointRecord *waypoints, size_t size, bool sync = true,
+              WaypointIoError *error = NULL);
+
+  // Write a snapshot if something changed since the last one.
+  bool snapshot(WaypointIoError *error = NULL);
+
+  const std::vector<WaypointRecord>& waypoints() const { return waypoints_; }
+  const std::string& filename() const { return filename_; }
+  unsigned long generation() const { return generation_; } // 今のsnapshotの世代
+  bool dirty() const { return journal_entries_ > 0; }
+  size_t journalEntries() const { return journal_entries_; } // snapshotからの行数
+  size_t replayedEntries() const { return replayed_entries_; } // open()で読み直した行数
+
+private:
+  bool loadSnapshot(WaypointIoError *error);
+  void replay();
+  bool startJournal(WaypointIoError *error);
+
+  std::string filename_;
+  std::string journal_filename_;
+  std::vector<WaypointRecord> waypoints_;
+  unsigned long generation_;
+  FILE *journal_;
+  size_t journal_entries_;
+  size_t replayed_entries_;
+  bool broken_; // journalへの書き込みに失敗した. 次はsnapshotから
+};
+
+} // namespace cirkit_waypoint_io
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef CIRKIT_WAYPOINT_IO_WAYPOINT_VALIDATE_H_
+#define CIRKIT_WAYPOINT_IO_WAYPOINT_VALIDATE_H_
+
+#include <cstddef>
+
+#include "cirkit_waypoint_io/waypoint_csv.h"
+
+namespace cirkit_waypoint_io {
+
+const double kQuaternionNormTolerance = 1e-3;
+const double kMinReachThreshold = 0.01; // [m]
+
+/**
+ * Check every waypoint and return the number of invalid ones.
+ * - all values are finite
+ * - quaternion is normalized
+ * - area_type is not negative
+ * - reach_threshold is at least kMinReachThreshold
+ * The first problem is reported in first_error (line = waypoint index + 1).
+ */
+size_t validateWaypoints(const WaypointRecord *waypoints, size_t size,
+                         WaypointIoError *first_error = NULL);
+
+} // namespace cirkit_waypoint_io
+
+#endif
@@ -0,0 +1,75 @@
+#include "cirkit_waypoint_io/compiled_route.h"
+
+#include <math.h>
+
+namespace cirkit_waypoint_io {
+
+void CompiledRoute::clear() {
+  x_.clear();
+  y_.clear();
+  yaw_.clear();
+  area_type_.clear();
+  reach_threshold_.clear();
+  segment_length_.clear();
+  heading_.clear();
+  direction_x_.clear();
+  direction_y_.clear();
+  arc_length_.clear();
+}
+
+void CompiledRoute::compile(const WaypointRecord *waypoints, size_t size) {
+  clear();
+  x_.resize(size);
+  y_.resize(size);
+  yaw_.resize(size);
+  area_type_.resize(size);
+  reach_threshold_.resize(size);
+  segment_length_.resize(size);
+  heading_.resize(size);
+  direction_x_.resize(size);
+  direction_y_.resize(size);
+  arc_length_.resize(size);
+
+  for (size_t i = 0; i < size; ++i) {
+    const WaypointRecord &w = waypoints[i];
+    x_[i] = w.x;
+    y_[i] = w.y;
+    yaw_[i] = atan2(2.0 * (w.qw * w.qz + w.qx * w.qy),
+                    1.0 - 2.0 * (w.qy * w.qy + w.qz * w.qz));
+    area_type_[i] = w.area_type;
+    reach_threshold_[i] = w.reach_threshold / 2.0;
+  }
+
+  double arc_length = 0.0;
+  for (size_t i = 0; i < size; ++i) {
+    arc_length_[i] = arc_length;
+    if (i + 1 < size) {
+      double dx = x_[i + 1] - x_[i];
+      double dy = y_[i + 1] - y_[i];
+      double length = sqrt(dx*dx + dy*dy);
+      segment_length_[i] = length;
+      if (length > 0.0) {
+        heading_[i] = atan2(dy, dx);
+        direction_x_[i] = dx / length;
+        direction_y_[i] = dy / length;
+      } else { // 同じ位置に重なったwaypointはwaypointの向きを使う
+        heading_[i] = yaw_[i];
+        direction_x_[i] = cos(yaw_[i]);
+        direction_y_[i] = sin(yaw_[i]);
+      }
+      arc_length += length;
+    } else if (i > 0) {
+      segment_length_[i] = 0.0;
+      heading_[i] = heading_[i - 1];
+      direction_x_[i] = direction_x_[i - 1];
+      direction_y_[i] = direction_y_[i - 1];
+    } else {
+      segment_length_[i] = 0.0;
+      heading_[i] = yaw_[i];
+      direction_x_[i] = cos(yaw_[i]);
+      direction_y_[i] = sin(yaw_[i]);
+    }
+  }
+}
+
+} // namespace cirkit_waypoint_io
@@ -0,0 +1,158 @@
+#include "cirkit_waypoint_io/route_spatial_index.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace cirkit_waypoint_io {
+
+namespace {
+
+const size_t kHeadingCandidates = 16;
+
+struct CompareX {
+  template <typename T>
+  bool operator()(const T &a, const T &b) const { return a.x < b.x; }
+};
+
+struct CompareY {
+  template <typename T>
+  bool operator()(const T &a, const T &b) const { return a.y < b.y; }
+};
+
+double normalizeAngle(double angle) {
+  return atan2(sin(angle), cos(angle));
+}
+
+} // namespace
+
+const size_t RouteSpatialIndex::kMaxNeighbors;
+
+RouteSpatialIndex::RouteSpatialIndex()
+  : route_(NULL)
+{}
+
+void RouteSpatialIndex::build(const CompiledRoute &route) {
+  route_ = &route;
+  nodes_.resize(route.size());
+  for (size_t i = 0; i < route.size(); ++i) {
+    nodes_[i].x = route.x(i);
+    nodes_[i].y = route.y(i);
+    nodes_[i].index = (int)i;
+  }
+  buildRecursive(0, nodes_.size(), 0);
+}
+
+void RouteSpatialIndex::clear() {
+  route_ = NULL;
+  nodes_.clear();
+}
+
+void RouteSpatialIndex::buildRecursive(size_t begin, size_t end, int depth) {
+  if (end - begin <= 1) {
+    return;
+  }
+  size_t mid = begin + (end - begin) / 2;
+  if (depth % 2 == 0) {
+    std::nth_element(nodes_.begin() + begin, nodes_.begin() + mid,
+                     nodes_.begin() + end, CompareX());
+  } else {
+    std::nth_element(nodes_.begin() + begin, nodes_.begin() + mid,
+                     nodes_.begin() + end, CompareY());
+  }
+  buildRecursive(begin, mid, depth + 1);
+  buildRecursive(mid + 1, end, depth + 1);
+}
+
+void RouteSpatialIndex::search(size_t begin, size_t end, int depth,
+                               double x, double y, Neighbors &neighbors) const {
+  if (begin >= end) {
+    return;
+  }
+  size_t mid = begin + (end - begin) / 2;
+  const Node &node = nodes_[mid];
+  double dx = x - node.x;
+  double dy = y - node.y;
+  double distance_sq = dx*dx + dy*dy;
+
+  // 近い順に並べたk個を保持する
+  if (neighbors.count < neighbors.k
+      || distance_sq < neighbors.distances_sq[neighbors.count - 1]) {
+    size_t i = (neighbors.count < neighbors.k) ? neighbors.count++ : neighbors.count - 1;
+    while (i > 0 && neighbors.distances_sq[i - 1] > distance_sq) {
+      neighbors.indices[i] = neighbors.indices[i - 1];
+      neighbors.distances_sq[i] = neighbors.distances_sq[i - 1];
+      --i;
+    }
+    neighbors.indices[i] = node.index;
+    neighbors.distances_sq[i] = distance_sq;
+  }
+
+  double diff = (depth % 2 == 0) ? dx : dy;
+  if (diff < 0) {
+    search(begin, mid, depth + 1, x, y, neighbors);
+    if (neighbors.count < neighbors.k
+        || diff * diff < neighbors.distances_sq[neighbors.count - 1]) {
+      search(mid + 1, end, depth + 1, x, y, neighbors);
+    }
+  } else {
+    search(mid + 1, end, depth + 1, x, y, neighbors);
+    if (neighbors.count < neighbors.k
+        || diff * diff < neighbors.distances_sq[neighbors.count - 1]) {
+      search(begin, mid, depth + 1, x, y, neighbors);
+    }
+  }
+}
+
+size_t RouteSpatialIndex::nearest(double x, double y, size_t k,
+                                  int *indices, double *distances_sq) const {
+  Neighbors neighbors;
+  neighbors.k = std::min(k, kMaxNeighbors);
+  neighbors.count = 0;
+  if (neighbors.k == 0) {
+    return 0;
+  }
+  search(0, nodes_.size(), 0, x, y, neighbors);
+  for (size_t i = 0; i < neighbors.count; ++i) {
+    indices[i] = neighbors.indices[i];
+    if (distances_sq) {
+      distances_sq[i] = neighbors.distances_sq[i];
+    }
+  }
+  return neighbors.count;
+}
+
+int RouteSpatialIndex::nearestWaypoint(double x, double y, double heading,
+                                       double heading_weight) const {
+  int indices[kHeadingCandidates];
+  double distances_sq[kHeadingCandidates];
+  size_t count = nearest(x, y, kHeadingCandidates, indices, distances_sq);
+  int best = -1;
+  double best_cost = 0;
+  for (size_t i = 0; i < count; ++i) {
+    double heading_diff = fabs(normalizeAngle(heading - route_->heading(indices[i])));
+    double cost = sqrt(distances_sq[i]) + heading_weight * heading_diff;
+    if (best < 0 || cost < best_cost) {
+      best = indices[i];
+      best_cost = cost;
+    }
+  }
+  return best;
+}
+
+int RouteSpatialIndex::resumeWaypoint(double x, double y, double heading,
+                                      double heading_weight) const {
+  int i = nearestWaypoint(x, y, heading, heading_weight);
+  if (i < 0) {
+    return -1;
+  }
+  if (route_->isReached(i, x, y)) {
+    return i + 1;
+  }
+  // 進行方向に対してwaypointより前にいれば次のwaypointへ
+  double along = (x - route_->x(i)) * route_->directionX(i)
+               + (y - route_->y(i)) * route_->directionY(i);
+  return along > 0 ? i + 1 : i;
+}
+
+} // namespace cirkit_waypoint_io
@@ -0,0 +1,342 @@
+/*-------------------------------------------------
+Waypoint I/O benchmark
+  parse / validate / convert throughput of every waypoint file under a
+  directory (recursive) and of synthetic routes up to 100k rows.
+  legacy_parse is the old boost::tokenizer + stringstream loop of readWaypoint().
+-------------------------------------------------- */
+
+#include <cirkit_waypoint_io/waypoint_binary.h>
+#include <cirkit_waypoint_io/waypoint_csv.h>
+#include <cirkit_waypoint_io/waypoint_validate.h>
+
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+#include <boost/tokenizer.hpp>
+
+using namespace cirkit_waypoint_io;
+
+typedef boost::tokenizer<boost::char_separator<char> > tokenizer;
+
+namespace {
+
+double min_time = 0.2; // 1ケースあたりの最低計測時間 [s]
+
+double now() {
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// peak RSS [KB]
+long peakRss() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+bool readFile(const std::string &filename, std::string &buffer) {
+  std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!ifs) {
+    return false;
+  }
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  buffer = ss.str();
+  return true;
+}
+
+size_t fileSize(const std::string &filename) {
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0) {
+    return 0;
+  }
+  return (size_t)st.st_size;
+}
+
+void listCsvFiles(const std::string &dir, std::vector<std::string> &files) {
+  DIR *dp = opendir(dir.c_str());
+  if (!dp) {
+    return;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dp)) != NULL) {
+    std::string name = entry->d_name;
+    if (name == "." || name == "..") {
+      continue;
+    }
+    std::string path = dir + "/" + name;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+      continue;
+    }
+    if (S_ISDIR(st.st_mode)) {
+      listCsvFiles(path, files);
+    } else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".csv") == 0) {
+      files.push_back(path);
+    }
+  }
+  closedir(dp);
+  std::sort(files.begin(), files.end());
+}
+
+// cirkit_waypoint_navigator の旧 readWaypoint() と同じ処理
+size_t legacyParse(const std::string &text) {
+  const int rows_num = 9;
+  boost::char_separator<char> sep("," ,"", boost::keep_empty_tokens);
+  std::istringstream ifs(text);
+  std::string line;
+  std::vector<std::vector<double> > rows;
+  while (ifs.good()) {
+    getline(ifs, line);
+    if (line.empty()) break;
+    tokenizer tokens(line, sep);
+    std::vector<double> data;
+    tokenizer::iterator it = tokens.begin();
+    for (; it != tokens.end() ; ++it) {
+      std::stringstream ss;
+      double d;
+      ss << *it;
+      ss >> d;
+      data.push_back(d);
+    }
+    if (data.size() != rows_num) {
+      break;
+    }
+    rows.push_back(data);
+  }
+  return rows.size();
+}
+
+struct Result {
+  std::string name;
+  std::string op;
+  size_t rows;
+  size_t bytes;
+  int iterations;
+  double seconds;
+};
+
+std::vector<Result> results;
+
+// Run func repeatedly for at least min_time and record the throughput.
+template <typename Func>
+void measure(const std::string &name, const std::string &op,
+             size_t rows, size_t bytes, Func func) {
+  int iterations = 0;
+  double begin = now();
+  double elapsed = 0;
+  do {
+    func();
+    ++iterations;
+    elapsed = now() - begin;
+  } while (elapsed < min_time);
+
+  Result result;
+  result.name = name;
+  result.op = op;
+  result.rows = rows;
+  result.bytes = bytes;
+  result.iterations = iterations;
+  result.seconds = elapsed / iterations;
+  results.push_back(result);
+
+  printf("%-48s %-14s %8zu rows %10zu B %12.0f rows/s %9.2f MB/s  peak RSS %ld KB\n",
+         name.c_str(), op.c_str(), rows, bytes,
+         rows / result.seconds, bytes / result.seconds / 1e6, peakRss());
+  fflush(stdout);
+}
+
+bool benchFile(const std::string &csv_file, const std::string &name,
+               const std::string &tmp_dir, bool legacy) {
+  std::string text;
+  if (!readFile(csv_file, text)) {
+    std::cerr << "ERROR: could not read " << csv_file << std::endl;
+    return false;
+  }
+  std::vector<WaypointRecord> records;
+  WaypointIoError error;
+  if (!parseWaypointCsv(text.data(), text.size(), records, &error)) {
+    error.filename = csv_file;
+    std::cerr << "ERROR: " << error.toString() << std::endl;
+    return false;
+  }
+  const size_t rows = records.size();
+  const std::string binary_file = tmp_dir + "/bench" + kWaypointBinaryExtension;
+  const std::string csv_out_file = tmp_dir + "/bench.csv";
+
+  measure(name, "parse", rows, text.size(), [&]() {
+      std::vector<WaypointRecord> w;
+      parseWaypointCsv(text.data(), text.size(), w);
+    });
+  if (legacy) {
+    measure(name, "legacy_parse", rows, text.size(), [&]() {
+        legacyParse(text);
+      });
+  }
+  measure(name, "load_csv", rows, text.size(), [&]() {
+      WaypointFile w;
+      w.open(csv_file);
+    });
+
+  WaypointIoError validate_error;
+  size_t invalid = validateWaypoints(records.data(), rows, &validate_error);
+  measure(name, "validate", rows, rows * sizeof(WaypointRecord), [&]() {
+      validateWaypoints(records.data(), rows);
+    });
+  if (invalid > 0) {
+    validate_error.filename = csv_file;
+    std::cout << "  " << invalid << " invalid waypoints, first: "
+              << validate_error.toString() << std::endl;
+  }
+
+  measure(name, "csv_to_binary", rows, text.size(), [&]() {
+      writeWaypointBinary(binary_file, records.data(), rows);
+    });
+  const size_t binary_size = fileSize(binary_file);
+  measure(name, "load_binary", rows, binary_size, [&]() {
+      WaypointFile w;
+      w.open(binary_file);
+    });
+  measure(name, "binary_to_csv", rows, binary_size, [&]() {
+      writeWaypointCsv(csv_out_file, records.data(), rows);
+    });
+  unlink(binary_file.c_str());
+  unlink(csv_out_file.c_str());
+  return true;
+}
+
+// 半径50mの円をなぞる1m間隔くらいのルート
+std::string makeSyntheticRoute(const std::string &tmp_dir, size_t rows) {
+  std::vector<WaypointRecord> records(rows);
+  for (size_t i = 0; i < rows; ++i) {
+    double t = 2.0 * M_PI * i / 314.0;
+    double yaw = t + M_PI / 2.0;
+    WaypointRecord &w = records[i];
+    w.x = 50.0 * cos(t) + 0.001 * i;
+    w.y = 50.0 * sin(t);
+    w.z = 0;
+    w.qx = 0;
+    w.qy = 0;
+    w.qz = sin(yaw / 2.0);
+    w.qw = cos(yaw / 2.0);
+    w.area_type = (i / 100) % 2;
+    w.reach_threshold = 3.0;
+    w.reserved = 0;
+  }
+  std::stringstream ss;
+  ss << tmp_dir << "/synthetic_" << rows << ".csv";
+  writeWaypointCsv(ss.str(), records.data(), rows);
+  return ss.str();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  boost::program_options::options_description desc("Options");
+  desc.add_options()
+    ("help", "Print help message")
+    ("dir", boost::program_options::value<std::string>()->default_value(WAYPOINTS_DIR),
+     "waypoints directory (searched recursively)")
+    ("synthetic", boost::program_options::value<std::vector<size_t> >()->multitoken(),
+     "synthetic route sizes (default: 1000 10000 100000)")
+    ("min-time", boost::program_options::value<double>(&min_time)->default_value(0.2), "minimum time per case [s]")
+    ("no-legacy", "skip the legacy tokenizer parser");
+  boost::program_options::positional_options_description pos;
+  pos.add("dir", 1);
+
+  boost::program_options::variables_map vm;
+  try {
+    boost::program_options::store(boost::program_options::command_line_parser(argc, argv)
+                                  .options(desc).positional(pos).run(), vm);
+    boost::program_options::notify(vm);
+    if (vm.count("help")) {
+      std::cout << "Usage: cirkit_waypoint_bench [waypoints_dir] [options]" << std::endl;
+      std::cerr << desc << std::endl;
+      return 0;
+    }
+  } catch (boost::program_options::error& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl << std::endl;
+    std::cerr << desc << std::endl;
+    return -1;
+  }
+  const bool legacy = !vm.count("no-legacy");
+
+  char tmp_template[] = "/tmp/cirkit_waypoint_bench.XXXXXX";
+  if (!mkdtemp(tmp_template)) {
+    std::cerr << "ERROR: could not create a temporary directory" << std::endl;
+    return -1;
+  }
+  const std::string tmp_dir = tmp_template;
+
+  int failed = 0;
+  if (vm.count("dir")) {
+    const std::string dir = vm["dir"].as<std::string>();
+    std::vector<std::string> files;
+    listCsvFiles(dir, files);
+    if (files.empty()) {
+      std::cerr << "WARN: no csv file in " << dir << std::endl;
+    }
+    for (size_t i = 0; i < files.size(); ++i) {
+      std::string name = files[i].substr(dir.size() + 1);
+      if (!benchFile(files[i], name, tmp_dir, legacy)) {
+        ++failed;
+      }
+    }
+  }
+
+  std::vector<size_t> sizes;
+  if (vm.count("synthetic")) {
+    sizes = vm["synthetic"].as<std::vector<size_t> >();
+  } else {
+    sizes.push_back(1000);
+    sizes.push_back(10000);
+    sizes.push_back(100000);
+  }
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    std::string file = makeSyntheticRoute(tmp_dir, sizes[i]);
+    std::stringstream name;
+    name << "synthetic/" << sizes[i];
+    if (!benchFile(file, name.str(), tmp_dir, legacy)) {
+      ++failed;
+    }
+    unlink(file.c_str());
+  }
+  rmdir(tmp_dir.c_str());
+
+  // op毎の合計
+  std::vector<std::string> ops;
+  for (size_t i = 0; i < results.size(); ++i) {
+    if (std::find(ops.begin(), ops.end(), results[i].op) == ops.end()) {
+      ops.push_back(results[i].op);
+    }
+  }
+  printf("\n%-14s %12s %14s %12s\n", "op", "rows", "rows/s", "MB/s");
+  for (size_t i = 0; i < ops.size(); ++i) {
+    double rows = 0, bytes = 0, seconds = 0;
+    for (size_t j = 0; j < results.size(); ++j) {
+      if (results[j].op == ops[i]) {
+        rows += results[j].rows;
+        bytes += results[j].bytes;
+        seconds += results[j].seconds;
+      }
+    }
+    printf("%-14s %12.0f %14.0f %12.2f\n", ops[i].c_str(), rows, rows / seconds, bytes / seconds / 1e6);
+  }
+  printf("peak RSS: %ld KB\n", peakRss());
+  return failed == 0 ? 0 : -1;
+}
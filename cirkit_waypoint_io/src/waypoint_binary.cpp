@@ -0,0 +1,177 @@
+#include "cirkit_waypoint_io/waypoint_binary.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <sstream>
+
+namespace cirkit_waypoint_io {
+
+namespace {
+
+bool setError(WaypointIoError *error, const std::string &message) {
+  if (error) {
+    error->line = 0;
+    error->column = 0;
+    error->message = message;
+  }
+  return false;
+}
+
+bool hasExtension(const std::string &filename, const char *extension) {
+  size_t length = strlen(extension);
+  return filename.size() >= length
+      && filename.compare(filename.size() - length, length, extension) == 0;
+}
+
+} // namespace
+
+WaypointFileFormat detectWaypointFileFormat(const std::string &filename) {
+  FILE *fp = fopen(filename.c_str(), "rb");
+  if (!fp) {
+    return WAYPOINT_FILE_UNKNOWN;
+  }
+  char magic[sizeof(kWaypointBinaryMagic)];
+  size_t read_size = fread(magic, 1, sizeof(magic), fp);
+  fclose(fp);
+  if (read_size == sizeof(magic)
+      && memcmp(magic, kWaypointBinaryMagic, sizeof(magic)) == 0) {
+    return WAYPOINT_FILE_BINARY;
+  }
+  if (hasExtension(filename, kWaypointBinaryExtension)) {
+    return WAYPOINT_FILE_BINARY;
+  }
+  return WAYPOINT_FILE_CSV;
+}
+
+bool writeWaypointBinary(const std::string &filename,
+                         const WaypointRecord *waypoints, size_t size,
+                         WaypointIoError *error) {
+  if (error) {
+    error->filename = filename;
+  }
+  WaypointBinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kWaypointBinaryMagic, sizeof(header.magic));
+  header.version = kWaypointBinaryVersion;
+  header.record_size = sizeof(WaypointRecord);
+  header.count = size;
+  header.byte_order = kWaypointBinaryByteOrder;
+
+  FILE *fp = fopen(filename.c_str(), "wb");
+  if (!fp) {
+    return setError(error, "could not open file for writing");
+  }
+  bool success = fwrite(&header, sizeof(header), 1, fp) == 1;
+  if (success && size > 0) {
+    success = fwrite(waypoints, sizeof(WaypointRecord), size, fp) == size;
+  }
+  if (fclose(fp) != 0) {
+    success = false;
+  }
+  if (!success) {
+    return setError(error, "could not write file");
+  }
+  return true;
+}
+
+WaypointFile::WaypointFile()
+  : format_(WAYPOINT_FILE_UNKNOWN), records_(NULL), size_(0),
+    mapped_(NULL), mapped_length_(0)
+{}
+
+WaypointFile::~WaypointFile() {
+  close();
+}
+
+bool WaypointFile::open(const std::string &filename, WaypointIoError *error) {
+  close();
+  if (error) {
+    error->filename = filename;
+  }
+  WaypointFileFormat format = detectWaypointFileFormat(filename);
+  if (format == WAYPOINT_FILE_UNKNOWN) {
+    return setError(error, "could not open file");
+  }
+  if (format == WAYPOINT_FILE_BINARY) {
+    return mapBinary(filename, error);
+  }
+  if (!readWaypointCsv(filename, parsed_, error)) {
+    parsed_.clear();
+    return false;
+  }
+  format_ = WAYPOINT_FILE_CSV;
+  records_ = parsed_.empty() ? NULL : &parsed_[0];
+  size_ = parsed_.size();
+  return true;
+}
+
+void WaypointFile::close() {
+  if (mapped_) {
+    munmap(mapped_, mapped_length_);
+  }
+  mapped_ = NULL;
+  mapped_length_ = 0;
+  std::vector<WaypointRecord>().swap(parsed_);
+  format_ = WAYPOINT_FILE_UNKNOWN;
+  records_ = NULL;
+  size_ = 0;
+}
+
+bool WaypointFile::mapBinary(const std::string &filename, WaypointIoError *error) {
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return setError(error, "could not open file");
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return setError(error, "could not get file size");
+  }
+  size_t length = (size_t)st.st_size;
+  if (length < sizeof(WaypointBinaryHeader)) {
+    ::close(fd);
+    return setError(error, "too short for a waypoint binary file");
+  }
+  void *addr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    return setError(error, "could not mmap file");
+  }
+
+  const WaypointBinaryHeader *header = static_cast<const WaypointBinaryHeader*>(addr);
+  std::string message;
+  if (memcmp(header->magic, kWaypointBinaryMagic, sizeof(header->magic)) != 0) {
+    message = "not a waypoint binary file (bad magic)";
+  } else if (header->byte_order != kWaypointBinaryByteOrder) {
+    message = "byte order mismatch";
+  } else if (header->version != kWaypointBinaryVersion) {
+    std::stringstream ss;
+    ss << "unsupported version " << header->version
+       << " (expected " << kWaypointBinaryVersion << ")";
+    message = ss.str();
+  } else if (header->record_size != sizeof(WaypointRecord)) {
+    message = "record size mismatch";
+  } else if ((length - sizeof(WaypointBinaryHeader)) / sizeof(WaypointRecord) < header->count) {
+    message = "truncated file";
+  }
+  if (!message.empty()) {
+    munmap(addr, length);
+    return setError(error, message);
+  }
+
+  madvise(addr, length, MADV_WILLNEED);
+  mapped_ = addr;
+  mapped_length_ = length;
+  format_ = WAYPOINT_FILE_BINARY;
+  records_ = reinterpret_cast<const WaypointRecord*>(
+    static_cast<const char*>(addr) + sizeof(WaypointBinaryHeader));
+  size_ = (size_t)header->count;
+  return true;
+}
+
+} // namespace cirkit_waypoint_io
@@ -0,0 +1,71 @@
+#include <cirkit_waypoint_io/waypoint_binary.h>
+#include <cirkit_waypoint_io/waypoint_csv.h>
+
+#include <iostream>
+#include <string>
+
+#include <boost/program_options.hpp>
+
+using namespace cirkit_waypoint_io;
+
+int main(int argc, char** argv)
+{
+  boost::program_options::options_description desc("Options");
+  desc.add_options()
+    ("help", "Print help message")
+    ("input", boost::program_options::value<std::string>(), "input waypoint file (csv or binary)")
+    ("output", boost::program_options::value<std::string>(), "output waypoint file")
+    ("to", boost::program_options::value<std::string>(), "output format, csv or binary (default: by output extension)");
+  boost::program_options::positional_options_description pos;
+  pos.add("input", 1).add("output", 1);
+
+  boost::program_options::variables_map vm;
+  try {
+    boost::program_options::store(boost::program_options::command_line_parser(argc, argv)
+                                  .options(desc).positional(pos).run(), vm);
+    boost::program_options::notify(vm);
+  } catch (boost::program_options::error& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl << std::endl;
+    std::cerr << desc << std::endl;
+    return -1;
+  }
+  if (vm.count("help") || !vm.count("input") || !vm.count("output")) {
+    std::cout << "Convert waypoint files between csv and binary (" << kWaypointBinaryExtension << ")" << std::endl;
+    std::cout << "Usage: cirkit_waypoint_convert input output [--to csv|binary]" << std::endl;
+    std::cerr << desc << std::endl;
+    return vm.count("help") ? 0 : -1;
+  }
+  const std::string input = vm["input"].as<std::string>();
+  const std::string output = vm["output"].as<std::string>();
+
+  bool to_binary;
+  if (vm.count("to")) {
+    const std::string to = vm["to"].as<std::string>();
+    if (to != "csv" && to != "binary") {
+      std::cerr << "ERROR: --to must be csv or binary" << std::endl;
+      return -1;
+    }
+    to_binary = (to == "binary");
+  } else {
+    const std::string ext(kWaypointBinaryExtension);
+    to_binary = output.size() >= ext.size()
+        && output.compare(output.size() - ext.size(), ext.size(), ext) == 0;
+  }
+
+  WaypointFile waypoints;
+  WaypointIoError error;
+  if (!waypoints.open(input, &error)) {
+    std::cerr << "ERROR: " << error.toString() << std::endl;
+    return -1;
+  }
+  bool success = to_binary
+      ? writeWaypointBinary(output, waypoints.data(), waypoints.size(), &error)
+      : writeWaypointCsv(output, waypoints.data(), waypoints.size(), &error);
+  if (!success) {
+    std::cerr << "ERROR: " << error.toString() << std::endl;
+    return -1;
+  }
+  std::cout << waypoints.size() << " waypoints : " << input << " -> " << output
+            << (to_binary ? " (binary)" : " (csv)") << std::endl;
+  return 0;
+}
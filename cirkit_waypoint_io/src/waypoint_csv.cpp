@@ -0,0 +1,366 @@
+#include "cirkit_waypoint_io/waypoint_csv.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <sstream>
+
+namespace cirkit_waypoint_io {
+
+namespace {
+
+// 1e0 ~ 1e22 are exactly representable in double
+const double kPow10[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+const int kMaxExactPow10 = 22;
+const uint64_t kMaxExactMantissa = (uint64_t)1 << 53;
+const int kMaxMantissaDigits = 19;
+const size_t kMaxFallbackLength = 63;
+
+inline bool isDigit(char c) {
+  return '0' <= c && c <= '9';
+}
+
+inline bool isBlank(char c) {
+  return c == ' ' || c == '\t';
+}
+
+inline bool isEndOfLine(char c) {
+  return c == '\n' || c == '\r';
+}
+
+const char* skipBlank(const char *p, const char *end) {
+  while (p < end && isBlank(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+const char* skipLine(const char *p, const char *end) {
+  while (p < end && *p != '\n') {
+    ++p;
+  }
+  return p;
+}
+
+/**
+ * Parse a floating-point number starting at p.
+ * Returns the pointer past the number, or NULL if it is not a number.
+ * Numbers which fit in a double mantissa with |exponent| <= 22 are computed
+ * directly (exactly rounded). Others fall back to strtod() on a stack copy.
+ */
+const char* parseDouble(const char *p, const char *end, double &value) {
+  const char *begin = p;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    ++p;
+  }
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool truncated = false;
+  bool has_digits = false;
+  for (; p < end && isDigit(*p); ++p) {
+    has_digits = true;
+    if (digits < kMaxMantissaDigits) {
+      mantissa = mantissa * 10 + (*p - '0');
+      if (mantissa != 0) {
+        ++digits;
+      }
+    } else {
+      ++exponent;
+      truncated = true;
+    }
+  }
+  if (p < end && *p == '.') {
+    ++p;
+    for (; p < end && isDigit(*p); ++p) {
+      has_digits = true;
+      if (digits < kMaxMantissaDigits) {
+        mantissa = mantissa * 10 + (*p - '0');
+        if (mantissa != 0) {
+          ++digits;
+        }
+        --exponent;
+      } else {
+        truncated = true;
+      }
+    }
+  }
+  if (!has_digits) {
+    return NULL;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    bool exp_negative = false;
+    if (q < end && (*q == '-' || *q == '+')) {
+      exp_negative = (*q == '-');
+      ++q;
+    }
+    if (q == end || !isDigit(*q)) {
+      return NULL;
+    }
+    int exp_value = 0;
+    for (; q < end && isDigit(*q); ++q) {
+      if (exp_value < 100000) {
+        exp_value = exp_value * 10 + (*q - '0');
+      }
+    }
+    exponent += exp_negative ? -exp_value : exp_value;
+    p = q;
+  }
+
+  if (!truncated && mantissa <= kMaxExactMantissa
+      && -kMaxExactPow10 <= exponent && exponent <= kMaxExactPow10) {
+    double d = (double)mantissa;
+    if (exponent < 0) {
+      d /= kPow10[-exponent];
+    } else {
+      d *= kPow10[exponent];
+    }
+    value = negative ? -d : d;
+    return p;
+  }
+
+  // slow path: too many digits or a large exponent
+  size_t length = p - begin;
+  if (length > kMaxFallbackLength) {
+    return NULL;
+  }
+  char buf[kMaxFallbackLength + 1];
+  memcpy(buf, begin, length);
+  buf[length] = '\0';
+  value = strtod(buf, NULL);
+  return p;
+}
+
+// Values with up to kFixedDecimals decimals (as in hand-written and rounded routes) are
+// written as integers with a decimal point, which reads back exactly because
+// k / 10^kFixedDecimals is rounded the same way by the division and by strtod().
+// Anything else is written once with %.17g, which always reads back exactly.
+const int kFixedDecimals = 6;
+const double kFixedScale = 1e6;
+const double kFixedLimit = 1e12; // |value| * kFixedScale がint64に余裕で収まる範囲
+
+int formatDouble(char *buf, size_t size, double value) {
+  if (fabs(value) < kFixedLimit) {
+    double scaled = value * kFixedScale;
+    long long k = llround(scaled);
+    if ((double)k / kFixedScale == value && (k != 0 || !signbit(value))) {
+      char digits[32];
+      unsigned long long u = k < 0 ? -(unsigned long long)k : (unsigned long long)k;
+      int n = 0;
+      do { // 下の桁から
+        digits[n++] = (char)('0' + u % 10);
+        u /= 10;
+      } while (u > 0 || n <= kFixedDecimals);
+      int decimals = kFixedDecimals;
+      int first = 0;
+      while (decimals > 0 && digits[first] == '0') { // 小数の末尾の0を落とす
+        ++first;
+        --decimals;
+      }
+      int length = 0;
+      char out[40];
+      if (k < 0) {
+        out[length++] = '-';
+      }
+      for (int i = n - 1; i >= first; --i) {
+        if (i == kFixedDecimals - 1 && decimals > 0) {
+          out[length++] = '.';
+        }
+        out[length++] = digits[i];
+      }
+      if ((size_t)length >= size) {
+        return snprintf(buf, size, "%.17g", value);
+      }
+      memcpy(buf, out, length);
+      buf[length] = '\0';
+      return length;
+    }
+  }
+  return snprintf(buf, size, "%.17g", value);
+}
+
+bool setError(WaypointIoError *error, size_t line, size_t column,
+              const std::string &message) {
+  if (error) {
+    error->line = line;
+    error->column = column;
+    error->message = message;
+  }
+  return false;
+}
+
+} // namespace
+
+std::string WaypointIoError::toString() const {
+  std::stringstream ss;
+  ss << (filename.empty() ? "<input>" : filename);
+  if (line > 0) {
+    ss << ":" << line;
+    if (column > 0) {
+      ss << ":" << column;
+    }
+  }
+  ss << ": " << message;
+  return ss.str();
+}
+
+bool parseWaypointCsv(const char *data, size_t size,
+                      std::vector<WaypointRecord> &waypoints,
+                      WaypointIoError *error) {
+  const char *p = data;
+  const char *end = data + size;
+  size_t line = 0;
+  bool header_allowed = true;
+  double fields[kWaypointCsvColumns];
+
+  // 1行はだいたい40~60byte
+  waypoints.reserve(waypoints.size() + size / 48 + 1);
+
+  while (p < end) {
+    ++line;
+    const char *line_begin = p;
+    p = skipBlank(p, end);
+    if (p == end) {
+      break;
+    }
+    if (isEndOfLine(*p) || *p == '#') { // blank line or comment
+      p = skipLine(p, end);
+      if (p < end) {
+        ++p;
+      }
+      continue;
+    }
+    if (header_allowed && !isDigit(*p) && *p != '-' && *p != '+' && *p != '.') {
+      header_allowed = false;
+      p = skipLine(p, end);
+      if (p < end) {
+        ++p;
+      }
+      continue;
+    }
+    header_allowed = false;
+
+    size_t columns = 0;
+    while (true) {
+      p = skipBlank(p, end);
+      size_t column = p - line_begin + 1;
+      if (columns == kWaypointCsvColumns) {
+        std::stringstream ss;
+        ss << "too many columns (expected " << kWaypointCsvColumns << ")";
+        return setError(error, line, column, ss.str());
+      }
+      const char *next = parseDouble(p, end, fields[columns]);
+      if (!next) {
+        return setError(error, line, column, "invalid number");
+      }
+      ++columns;
+      p = skipBlank(next, end);
+      if (p == end || isEndOfLine(*p) || *p == '#') {
+        break;
+      }
+      if (*p != ',') {
+        return setError(error, line, p - line_begin + 1,
+                        std::string("unexpected character '") + *p + "'");
+      }
+      ++p;
+    }
+    if (columns != kWaypointCsvColumns) {
+      std::stringstream ss;
+      ss << "row size mismatch (expected " << kWaypointCsvColumns
+         << " columns, got " << columns << ")";
+      return setError(error, line, p - line_begin + 1, ss.str());
+    }
+    p = skipLine(p, end);
+    if (p < end) {
+      ++p;
+    }
+
+    WaypointRecord record;
+    record.x = fields[0];
+    record.y = fields[1];
+    record.z = fields[2];
+    record.qx = fields[3];
+    record.qy = fields[4];
+    record.qz = fields[5];
+    record.qw = fields[6];
+    record.area_type = (int32_t)fields[7];
+    record.reach_threshold = fields[8];
+    record.reserved = 0;
+    waypoints.push_back(record);
+  }
+  return true;
+}
+
+bool readWaypointCsv(const std::string &filename,
+                     std::vector<WaypointRecord> &waypoints,
+                     WaypointIoError *error) {
+  if (error) {
+    error->filename = filename;
+  }
+  std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!ifs) {
+    return setError(error, 0, 0, "could not open file");
+  }
+  ifs.seekg(0, std::ios::end);
+  std::streamoff size = ifs.tellg();
+  ifs.seekg(0, std::ios::beg);
+  if (size < 0) {
+    return setError(error, 0, 0, "could not get file size");
+  }
+  std::vector<char> buffer((size_t)size);
+  if (size > 0 && !ifs.read(&buffer[0], size)) {
+    return setError(error, 0, 0, "could not read file");
+  }
+  return parseWaypointCsv(buffer.empty() ? NULL : &buffer[0], buffer.size(),
+                          waypoints, error);
+}
+
+bool writeWaypointCsv(const std::string &filename,
+                      const WaypointRecord *waypoints, size_t size,
+                      WaypointIoError *error, const std::string &comment) {
+  if (error) {
+    error->filename = filename;
+  }
+  FILE *fp = fopen(filename.c_str(), "w");
+  if (!fp) {
+    return setError(error, 0, 0, "could not open file for writing");
+  }
+  if (!comment.empty() && fprintf(fp, "# %s\n", comment.c_str()) < 0) {
+    fclose(fp);
+    return setError(error, 0, 0, "could not write file");
+  }
+  char line[kWaypointCsvColumns * 32];
+  for (size_t i = 0; i < size; ++i) {
+    const WaypointRecord &w = waypoints[i];
+    const double values[] = {w.x, w.y, w.z, w.qx, w.qy, w.qz, w.qw};
+    int length = 0;
+    for (size_t j = 0; j < sizeof(values) / sizeof(values[0]); ++j) {
+      length += formatDouble(line + length, sizeof(line) - length, values[j]);
+      line[length++] = ',';
+    }
+    length += snprintf(line + length, sizeof(line) - length, "%d,", (int)w.area_type);
+    length += formatDouble(line + length, sizeof(line) - length, w.reach_threshold);
+    line[length++] = '\n';
+    if (fwrite(line, 1, length, fp) != (size_t)length) {
+      fclose(fp);
+      return setError(error, i + 1, 0, "could not write file");
+    }
+  }
+  if (fclose(fp) != 0) {
+    return setError(error, 0, 0, "could not write file");
+  }
+  return true;
+}
+
+} // namespace cirkit_waypoint_io
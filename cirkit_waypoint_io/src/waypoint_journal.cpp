@@ -0,0 +1,258 @@
+#include "cirkit_waypoint_io/waypoint_journal.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+
+namespace cirkit_waypoint_io {
+
+namespace {
+
+const size_t kJournalBufferSize = 1 << 16;
+const char kGenerationComment[] = "journal generation ";
+
+bool setError(WaypointIoError *error, const std::string &filename,
+              size_t line, const std::string &message) {
+  if (error) {
+    error->filename = filename;
+    error->line = line;
+    error->column = 0;
+    error->message = message;
+  }
+  return false;
+}
+
+bool sameRecord(const WaypointRecord &a, const WaypointRecord &b) {
+  return a.x == b.x && a.y == b.y && a.z == b.z
+      && a.qx == b.qx && a.qy == b.qy && a.qz == b.qz && a.qw == b.qw
+      && a.area_type == b.area_type && a.reach_threshold == b.reach_threshold;
+}
+
+bool fileExists(const std::string &filename) {
+  return access(filename.c_str(), F_OK) == 0;
+}
+
+bool syncPath(const std::string &path, int flags) {
+  int fd = ::open(path.c_str(), flags);
+  if (fd < 0) {
+    return false;
+  }
+  bool success = fsync(fd) == 0;
+  ::close(fd);
+  return success;
+}
+
+std::string directoryOf(const std::string &filename) {
+  size_t slash = filename.rfind('/');
+  if (slash == std::string::npos) {
+    return ".";
+  }
+  return slash == 0 ? "/" : filename.substr(0, slash);
+}
+
+} // namespace
+
+WaypointJournal::WaypointJournal()
+  : generation_(0), journal_(NULL), journal_entries_(0), replayed_entries_(0), broken_(false)
+{}
+
+WaypointJournal::~WaypointJournal() {
+  close();
+}
+
+bool WaypointJournal::open(const std::string &filename, WaypointIoError *error) {
+  close();
+  filename_ = filename;
+  journal_filename_ = filename + ".journal";
+  waypoints_.clear();
+  generation_ = 0;
+  journal_entries_ = 0;
+  replayed_entries_ = 0;
+  broken_ = false;
+  if (fileExists(filename_) && !loadSnapshot(error)) {
+    return false;
+  }
+  replay();
+  if (replayed_entries_ > 0) { // 読み直した分は新しいsnapshotにして, journalを空から始める
+    journal_entries_ = replayed_entries_;
+    return snapshot(error);
+  }
+  return startJournal(error);
+}
+
+bool WaypointJournal::close(WaypointIoError *error) {
+  bool success = true;
+  if (journal_) {
+    success = snapshot(error);
+    if (journal_) { // snapshot()が新しいjournalを開けなかったときはNULL
+      fclose(journal_);
+      journal_ = NULL;
+    }
+    if (success) { // 全部snapshotに入ったので空のjournalは残さない
+      unlink(journal_filename_.c_str());
+    }
+  }
+  return success;
+}
+
+bool WaypointJournal::update(const WaypointRecord *waypoints, size_t size, bool sync,
+                             WaypointIoError *error) {
+  if (!journal_) {
+    return setError(error, journal_filename_, 0, "journal is not open");
+  }
+  // 差分を先に全部作り, journalに書けてからwaypoints_に入れる
+  std::string diff;
+  size_t entries = 0;
+  char line[512];
+  if (size < waypoints_.size()) {
+    snprintf(line, sizeof(line), "N,%zu\n", size);
+    diff += line;
+    ++entries;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    if (i < waypoints_.size() && sameRecord(waypoints_[i], waypoints[i])) {
+      continue;
+    }
+    const WaypointRecord &w = waypoints[i];
+    snprintf(line, sizeof(line), "W,%zu,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%d,%.17g\n",
+             i, w.x, w.y, w.z, w.qx, w.qy, w.qz, w.qw, (int)w.area_type, w.reach_threshold);
+    diff += line;
+    ++entries;
+  }
+  if (entries == 0) {
+    return true;
+  }
+  if (broken_) { // 書きかけの行があるjournalには足さず, snapshotに全部書き直す
+    waypoints_.assign(waypoints, waypoints + size);
+    journal_entries_ += entries;
+    return snapshot(error);
+  }
+  if (fwrite(diff.data(), 1, diff.size(), journal_) != diff.size()
+      || fflush(journal_) != 0 || ferror(journal_)) {
+    broken_ = true; // 途中まで書けた行の後ろに次の差分を続けると, 読み直せなくなる
+    return setError(error, journal_filename_, 0, "could not write journal");
+  }
+  waypoints_.assign(waypoints, waypoints + size);
+  journal_entries_ += entries;
+  if (sync && fdatasync(fileno(journal_)) != 0) {
+    return setError(error, journal_filename_, 0, "could not sync journal");
+  }
+  return true;
+}
+
+bool WaypointJournal::snapshot(WaypointIoError *error) {
+  if (journal_entries_ == 0 && !broken_) {
+    return true;
+  }
+  std::string tmp = filename_ + ".tmp";
+  unsigned long generation = generation_ + 1;
+  std::ostringstream comment;
+  comment << kGenerationComment << generation;
+  if (!writeWaypointCsv(tmp, waypoints_.data(), waypoints_.size(), error, comment.str())) {
+    return false;
+  }
+  if (!syncPath(tmp, O_RDONLY)) {
+    return setError(error, tmp, 0, "could not sync snapshot");
+  }
+  if (rename(tmp.c_str(), filename_.c_str()) != 0) {
+    return setError(error, filename_, 0, "could not rename snapshot");
+  }
+  syncPath(directoryOf(filename_), O_RDONLY | O_DIRECTORY); // renameを確定させる
+  // ここで落ちても, 古い世代のjournalはsnapshotに入っているので読み直されない
+  generation_ = generation;
+  journal_entries_ = 0;
+  return startJournal(error);
+}
+
+bool WaypointJournal::loadSnapshot(WaypointIoError *error) {
+  if (!readWaypointCsv(filename_, waypoints_, error)) {
+    return false;
+  }
+  std::ifstream ifs(filename_.c_str());
+  std::string line;
+  const std::string prefix = std::string("# ") + kGenerationComment;
+  if (std::getline(ifs, line) && line.compare(0, prefix.size(), prefix) == 0) {
+    generation_ = strtoul(line.c_str() + prefix.size(), NULL, 10);
+  } // 世代の無い普通のcsvは0
+  return true;
+}
+
+void WaypointJournal::replay() {
+  std::ifstream ifs(journal_filename_.c_str(), std::ios::in | std::ios::binary);
+  if (!ifs) {
+    return; // journalが無い
+  }
+  std::stringstream buffer;
+  buffer << ifs.rdbuf();
+  const std::string text = buffer.str();
+  // 最初の行がsnapshotと同じ世代でなければ, もうsnapshotに入っている
+  size_t begin = text.find('\n');
+  if (begin == std::string::npos || text.compare(0, 2, "G,") != 0) {
+    return;
+  }
+  char *p = NULL;
+  unsigned long generation = strtoul(text.c_str() + 2, &p, 10);
+  if (p != text.c_str() + begin || generation != generation_) {
+    return;
+  }
+  ++begin;
+  while (begin < text.size()) {
+    size_t end = text.find('\n', begin);
+    if (end == std::string::npos) {
+      break; // 書いている途中で止まった行
+    }
+    const char *line = text.c_str() + begin;
+    size_t length = end - begin;
+    begin = end + 1;
+    if (length > 2 && line[0] == 'N' && line[1] == ',') {
+      unsigned long size = strtoul(line + 2, &p, 10);
+      if (p == line + 2 || size > waypoints_.size()) {
+        break;
+      }
+      waypoints_.resize(size);
+    } else if (length > 2 && line[0] == 'W' && line[1] == ',') {
+      unsigned long index = strtoul(line + 2, &p, 10);
+      if (p == line + 2 || *p != ',' || index > waypoints_.size()) {
+        break;
+      }
+      ++p;
+      std::vector<WaypointRecord> records;
+      if (!parseWaypointCsv(p, line + length - p, records) || records.size() != 1) {
+        break;
+      }
+      if (index < waypoints_.size()) {
+        waypoints_[index] = records[0];
+      } else {
+        waypoints_.push_back(records[0]);
+      }
+    } else {
+      break;
+    }
+    ++replayed_entries_;
+  }
+  // 壊れた行より後は捨てる. 次のsnapshot()でjournalごと消える
+}
+
+bool WaypointJournal::startJournal(WaypointIoError *error) {
+  if (journal_) {
+    fclose(journal_);
+    journal_ = NULL;
+  }
+  journal_ = fopen(journal_filename_.c_str(), "w");
+  if (!journal_) {
+    return setError(error, journal_filename_, 0, "could not open journal");
+  }
+  setvbuf(journal_, NULL, _IOFBF, kJournalBufferSize);
+  fprintf(journal_, "G,%lu\n", generation_);
+  if (fflush(journal_) != 0 || fdatasync(fileno(journal_)) != 0) {
+    return setError(error, journal_filename_, 0, "could not write journal");
+  }
+  broken_ = false;
+  return true;
+}
+
+} // namespace cirkit_waypoint_io
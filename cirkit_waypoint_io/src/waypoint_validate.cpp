@@ -0,0 +1,49 @@
+#include "cirkit_waypoint_io/waypoint_validate.h"
+
+#include <math.h>
+
+namespace cirkit_waypoint_io {
+
+namespace {
+
+const char* checkWaypoint(const WaypointRecord &w) {
+  const double values[] = {w.x, w.y, w.z, w.qx, w.qy, w.qz, w.qw, w.reach_threshold};
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+    if (!isfinite(values[i])) {
+      return "not a finite number";
+    }
+  }
+  double norm = sqrt(w.qx*w.qx + w.qy*w.qy + w.qz*w.qz + w.qw*w.qw);
+  if (fabs(norm - 1.0) > kQuaternionNormTolerance) {
+    return "quaternion is not normalized";
+  }
+  if (w.area_type < 0) {
+    return "negative area_type";
+  }
+  if (w.reach_threshold < kMinReachThreshold) {
+    return "reach_threshold is too small";
+  }
+  return NULL;
+}
+
+} // namespace
+
+size_t validateWaypoints(const WaypointRecord *waypoints, size_t size,
+                         WaypointIoError *first_error) {
+  size_t invalid = 0;
+  for (size_t i = 0; i < size; ++i) {
+    const char *message = checkWaypoint(waypoints[i]);
+    if (!message) {
+      continue;
+    }
+    if (invalid == 0 && first_error) {
+      first_error->line = i + 1;
+      first_error->column = 0;
+      first_error->message = message;
+    }
+    ++invalid;
+  }
+  return invalid;
+}
+
+} // namespace cirkit_waypoint_io
@@ -0,0 +1,277 @@
+#include <gtest/gtest.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "cirkit_waypoint_io/waypoint_journal.h"
+
+using cirkit_waypoint_io::WaypointIoError;
+using cirkit_waypoint_io::WaypointJournal;
+using cirkit_waypoint_io::WaypointRecord;
+
+namespace {
+
+WaypointRecord makeRecord(double x) {
+  WaypointRecord record = {x, -0.5 * x, 0.0, 0.0, 0.0, 0.1, 0.99, 1.0, (int)x % 2, 0};
+  return record;
+}
+
+std::vector<WaypointRecord> makeRoute(size_t size) {
+  std::vector<WaypointRecord> route;
+  for (size_t i = 0; i < size; ++i) {
+    route.push_back(makeRecord(i + 0.25));
+  }
+  return route;
+}
+
+std::string readFile(const std::string &filename) {
+  std::ifstream ifs(filename.c_str(), std::ios::binary);
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  return ss.str();
+}
+
+void writeFile(const std::string &filename, const std::string &text) {
+  std::ofstream ofs(filename.c_str(), std::ios::binary | std::ios::trunc);
+  ofs << text;
+}
+
+void expectRoute(const std::vector<WaypointRecord> &expected, const WaypointJournal &journal) {
+  const std::vector<WaypointRecord> &actual = journal.waypoints();
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(expected[i].x, actual[i].x) << "row " << i;
+    EXPECT_EQ(expected[i].y, actual[i].y) << "row " << i;
+    EXPECT_EQ(expected[i].qz, actual[i].qz) << "row " << i;
+    EXPECT_EQ(expected[i].area_type, actual[i].area_type) << "row " << i;
+    EXPECT_EQ(expected[i].reach_threshold, actual[i].reach_threshold) << "row " << i;
+  }
+}
+
+class WaypointJournalTest : public ::testing::Test {
+protected:
+  WaypointJournalTest() {
+    char dir[] = "/tmp/test_waypoint_journal_XXXXXX";
+    dir_ = mkdtemp(dir);
+    filename_ = dir_ + "/route.csv";
+    journal_ = filename_ + ".journal";
+  }
+
+  ~WaypointJournalTest() {
+    unlink(filename_.c_str());
+    unlink(journal_.c_str());
+    unlink((filename_ + ".tmp").c_str());
+    rmdir(dir_.c_str());
+  }
+
+  std::string dir_;
+  std::string filename_;
+  std::string journal_;
+};
+
+TEST_F(WaypointJournalTest, CloseWritesSnapshotAndRemovesJournal)
+{
+  std::vector<WaypointRecord> route = makeRoute(5);
+  {
+    WaypointJournal journal;
+    ASSERT_TRUE(journal.open(filename_));
+    ASSERT_TRUE(journal.update(route.data(), route.size()));
+    EXPECT_EQ(5u, journal.journalEntries());
+    EXPECT_TRUE(journal.close());
+  }
+  EXPECT_NE(0, access(journal_.c_str(), F_OK));
+  WaypointJournal journal;
+  ASSERT_TRUE(journal.open(filename_));
+  EXPECT_EQ(0u, journal.replayedEntries());
+  expectRoute(route, journal);
+}
+
+TEST_F(WaypointJournalTest, UpdateJournalsOnlyChangedRows)
+{
+  std::vector<WaypointRecord> route = makeRoute(10);
+  WaypointJournal journal;
+  ASSERT_TRUE(journal.open(filename_));
+  ASSERT_TRUE(journal.update(route.data(), route.size()));
+  ASSERT_TRUE(journal.snapshot());
+  EXPECT_FALSE(journal.dirty());
+  ASSERT_TRUE(journal.update(route.data(), route.size()));
+  EXPECT_EQ(0u, journal.journalEntries());
+  route[4].x = 42.0;
+  route.push_back(makeRecord(11.0));
+  ASSERT_TRUE(journal.update(route.data(), route.size()));
+  EXPECT_EQ(2u, journal.journalEntries());
+  route.resize(3);
+  ASSERT_TRUE(journal.update(route.data(), route.size()));
+  EXPECT_EQ(3u, journal.journalEntries());
+  expectRoute(route, journal);
+}
+
+// snapshotを取らずに落ちたとき: snapshot + journalから戻る. 書きかけの最後の行は捨てる
+TEST_F(WaypointJournalTest, CrashReplaysJournal)
+{
+  std::vector<WaypointRecord> route = makeRoute(10);
+  std::string crashed_snapshot, crashed_journal;
+  {
+    WaypointJournal journal;
+    ASSERT_TRUE(journal.open(filename_));
+    ASSERT_TRUE(journal.update(route.data(), route.size()));
+    ASSERT_TRUE(journal.snapshot());
+    route[2].x = 100.0;
+    ASSERT_TRUE(journal.update(route.data(), route.size()));
+    route.resize(6);
+    ASSERT_TRUE(journal.update(route.data(), route.size()));
+    crashed_snapshot = readFile(filename_);
+    crashed_journal = readFile(journal_) + "W,6,1.0,2"; // 書いている途中で落ちた
+  }
+  writeFile(filename_, crashed_snapshot);
+  writeFile(journal_, crashed_journal);
+
+  WaypointJournal journal;
+  ASSERT_TRUE(journal.open(filename_));
+  EXPECT_EQ(2u, journal.replayedEntries());
+  EXPECT_FALSE(journal.dirty()); // 読み直した分はsnapshotに入っている
+  expectRoute(route, journal);
+}
+
+// snapshotのrenameの後, 新しいjournalを始める前に落ちたとき: 古いjournalを当て直さない
+TEST_F(WaypointJournalTest, CrashAfterSnapshotRenameIgnoresOldJournal)
+{
+  std::vector<WaypointRecord> route = makeRoute(10);
+  std::string old_journal;
+  {
+    WaypointJournal journal;
+    ASSERT_TRUE(journal.open(filename_));
+    ASSERT_TRUE(journal.update(route.data(), route.size()));
+    ASSERT_TRUE(journal.snapshot());
+    route[2].x = 100.0;
+    ASSERT_TRUE(journal.update(route.data(), route.size()));
+    route[7].x = 200.0;
+    ASSERT_TRUE(journal.update(route.data(), route.size()));
+    route[2].x = 300.0;
+    ASSERT_TRUE(journal.update(route.data(), route.size()));
+    route.resize(3);
+    ASSERT_TRUE(journal.update(route.data(), route.size()));
+    old_journal = readFile(journal_);
+    ASSERT_TRUE(journal.snapshot());
+  }
+  writeFile(journal_, old_journal); // 新しいsnapshotと, 消えなかった古いjournal
+
+  WaypointJournal journal;
+  ASSERT_TRUE(journal.open(filename_));
+  EXPECT_EQ(0u, journal.replayedEntries());
+  expectRoute(route, journal);
+  EXPECT_EQ(300.0, journal.waypoints()[2].x);
+  ASSERT_TRUE(journal.close());
+
+  ASSERT_TRUE(journal.open(filename_)); // 保存された方も正しい
+  expectRoute(route, journal);
+}
+
+// snapshotの書き出し中(rename前)に落ちたとき: 前のsnapshot + journalから戻る
+TEST_F(WaypointJournalTest, CrashBeforeSnapshotRenameReplaysJournal)
+{
+  std::vector<WaypointRecord> route = makeRoute(4);
+  std::string crashed_snapshot, crashed_journal;
+  {
+    WaypointJournal journal;
+    ASSERT_TRUE(journal.open(filename_));
+    ASSERT_TRUE(journal.update(route.data(), route.size()));
+    ASSERT_TRUE(journal.snapshot());
+    route[1].y = -7.0;
+    ASSERT_TRUE(journal.update(route.data(), route.size()));
+    crashed_snapshot = readFile(filename_);
+    crashed_journal = readFile(journal_);
+  }
+  writeFile(filename_, crashed_snapshot);
+  writeFile(journal_, crashed_journal);
+  writeFile(filename_ + ".tmp", "1,2"); // 書きかけのsnapshot
+
+  WaypointJournal journal;
+  ASSERT_TRUE(journal.open(filename_));
+  EXPECT_EQ(1u, journal.replayedEntries());
+  expectRoute(route, journal);
+}
+
+// journalの書き込みが途中で失敗したとき: routeは変えず, 次のupdate()でsnapshotに書き直す
+TEST_F(WaypointJournalTest, FailedWriteKeepsRouteAndForcesSnapshot)
+{
+  std::vector<WaypointRecord> route = makeRoute(5);
+  WaypointJournal journal;
+  ASSERT_TRUE(journal.open(filename_));
+  ASSERT_TRUE(journal.update(route.data(), route.size()));
+  ASSERT_TRUE(journal.snapshot());
+  const std::vector<WaypointRecord> saved = route;
+  const unsigned long generation = journal.generation();
+
+  // journalを今の大きさ+10byteまでしか書けなくする. 差分の行は途中で切れる
+  struct stat st;
+  ASSERT_EQ(0, stat(journal_.c_str(), &st));
+  struct rlimit limit;
+  ASSERT_EQ(0, getrlimit(RLIMIT_FSIZE, &limit));
+  struct rlimit small = limit;
+  small.rlim_cur = st.st_size + 10;
+  void (*handler)(int) = signal(SIGXFSZ, SIG_IGN);
+  ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &small));
+  route[2].x = 50.0;
+  bool written = journal.update(route.data(), route.size());
+  setrlimit(RLIMIT_FSIZE, &limit);
+  signal(SIGXFSZ, handler);
+  EXPECT_FALSE(written);
+  expectRoute(saved, journal); // 書けなかった差分は入れない
+  EXPECT_FALSE(journal.dirty());
+
+  {
+    WaypointJournal crashed; // ここで落ちたら: 切れた行は捨てて前のrouteに戻る
+    ASSERT_TRUE(crashed.open(filename_));
+    expectRoute(saved, crashed);
+  }
+  ASSERT_TRUE(journal.update(route.data(), route.size()));
+  EXPECT_EQ(generation + 1, journal.generation()); // 壊れたjournalには足さずsnapshotにした
+  EXPECT_FALSE(journal.dirty());
+  expectRoute(route, journal);
+  route[3].y = 60.0;
+  ASSERT_TRUE(journal.update(route.data(), route.size())); // 新しいjournalにまた足せる
+  EXPECT_EQ(1u, journal.journalEntries());
+  std::string crashed_snapshot = readFile(filename_);
+  std::string crashed_journal = readFile(journal_);
+  writeFile(filename_, crashed_snapshot);
+  writeFile(journal_, crashed_journal);
+
+  WaypointJournal recovered;
+  ASSERT_TRUE(recovered.open(filename_));
+  EXPECT_EQ(1u, recovered.replayedEntries());
+  expectRoute(route, recovered);
+}
+
+TEST_F(WaypointJournalTest, PlainCsvCanBeResumed)
+{
+  std::vector<WaypointRecord> route = makeRoute(3);
+  ASSERT_TRUE(cirkit_waypoint_io::writeWaypointCsv(filename_, route.data(), route.size()));
+  WaypointJournal journal;
+  ASSERT_TRUE(journal.open(filename_));
+  EXPECT_EQ(0u, journal.generation());
+  expectRoute(route, journal);
+  route.push_back(makeRecord(9.0));
+  ASSERT_TRUE(journal.update(route.data(), route.size()));
+  ASSERT_TRUE(journal.close());
+  ASSERT_TRUE(journal.open(filename_));
+  EXPECT_EQ(1u, journal.generation());
+  expectRoute(route, journal);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
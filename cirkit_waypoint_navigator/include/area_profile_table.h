@@ -0,0 +1,186 @@
+#ifndef AREA_PROFILE_TABLE_H_
+#define AREA_PROFILE_TABLE_H_
+
+#include <ros/ros.h>
+#include <dynamic_reconfigure/Config.h>
+#include <xmlrpcpp/XmlRpcValue.h>
+#include <dwa_local_planner/DWAPlannerConfig.h>
+#include <move_base/MoveBaseConfig.h>
+#include <costmap_2d/ObstaclePluginConfig.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+// 1つのarea typeで使うmove_base関係のconfig一式
+struct AreaProfile {
+  std::string name;
+  dwa_local_planner::DWAPlannerConfig dwa;
+  move_base::MoveBaseConfig move_base;
+  costmap_2d::ObstaclePluginConfig obstacles;
+};
+
+/**
+ * Planner configs per area type, built once at startup.
+ * Each profile is the default configs with the parameters listed in
+ * the profile overridden, e.g. (rosparam)
+ *
+ *   area_profiles:
+ *     - area_type: 3
+ *       name: slowdown
+ *       dwa: {max_vel_trans: 0.3, max_vel_x: 0.3, acc_lim_x: 1.5}
+ *       move_base: {}
+ *       obstacles: {}
+ *
+ * Any parameter of the dynamic_reconfigure configs can be listed by name.
+ * Area types without a profile use the default configs.
+ */
+class AreaProfileTable {
+public:
+  AreaProfileTable() {}
+
+  bool build(XmlRpc::XmlRpcValue &profiles,
+             const dwa_local_planner::DWAPlannerConfig &dwa_default,
+             const move_base::MoveBaseConfig &move_base_default,
+             const costmap_2d::ObstaclePluginConfig &obstacles_default) {
+    profiles_.clear();
+    defined_.clear();
+    default_profile_.name = "default";
+    default_profile_.dwa = dwa_default;
+    default_profile_.move_base = move_base_default;
+    default_profile_.obstacles = obstacles_default;
+
+    if (profiles.getType() != XmlRpc::XmlRpcValue::TypeArray) {
+      ROS_ERROR("area_profiles must be a list");
+      return false;
+    }
+    for (int i = 0; i < profiles.size(); ++i) {
+      XmlRpc::XmlRpcValue &entry = profiles[i];
+      if (entry.getType() != XmlRpc::XmlRpcValue::TypeStruct
+          || !entry.hasMember("area_type")
+          || entry["area_type"].getType() != XmlRpc::XmlRpcValue::TypeInt) {
+        ROS_ERROR("area_profiles[%d] needs an integer area_type", i);
+        return false;
+      }
+      int area_type = entry["area_type"];
+      if (area_type < 0) {
+        ROS_ERROR("area_profiles[%d] : area_type must be >= 0", i);
+        return false;
+      }
+      AreaProfile profile = default_profile_;
+      std::stringstream name;
+      name << "area_type " << area_type;
+      profile.name = name.str();
+      if (entry.hasMember("name")) {
+        if (entry["name"].getType() != XmlRpc::XmlRpcValue::TypeString) {
+          ROS_ERROR("area_profiles[%d] : name must be a string, skipped", i);
+          continue;
+        }
+        profile.name = static_cast<std::string>(entry["name"]);
+      }
+      if (!overrideConfig(entry, "dwa", profile.dwa)
+          || !overrideConfig(entry, "move_base", profile.move_base)
+          || !overrideConfig(entry, "obstacles", profile.obstacles)) {
+        ROS_ERROR("area_profiles[%d] (%s) is invalid", i, profile.name.c_str());
+        return false;
+      }
+      if ((int)profiles_.size() <= area_type) {
+        profiles_.resize(area_type + 1, default_profile_);
+        defined_.resize(area_type + 1, false);
+      }
+      profiles_[area_type] = profile;
+      defined_[area_type] = true;
+      ROS_INFO("Area profile %d : %s", area_type, profile.name.c_str());
+    }
+    return true;
+  }
+
+  // 定義されていないarea typeはdefault
+  const AreaProfile& profile(int area_type) const {
+    if (area_type < 0 || area_type >= (int)profiles_.size()) {
+      return default_profile_;
+    }
+    return profiles_[area_type];
+  }
+
+  bool isDefined(int area_type) const {
+    return area_type >= 0 && area_type < (int)defined_.size() && defined_[area_type];
+  }
+
+private:
+  // entry[key]に書かれたパラメータだけconfigを書き換える
+  template <typename T>
+  static bool overrideConfig(XmlRpc::XmlRpcValue &entry, const std::string &key, T &config) {
+    if (!entry.hasMember(key)) {
+      return true;
+    }
+    XmlRpc::XmlRpcValue &overrides = entry[key];
+    if (overrides.getType() != XmlRpc::XmlRpcValue::TypeStruct) {
+      ROS_ERROR("%s must be a map of parameter names to values", key.c_str());
+      return false;
+    }
+    dynamic_reconfigure::Config msg;
+    config.__toMessage__(msg);
+    for (XmlRpc::XmlRpcValue::iterator it = overrides.begin(); it != overrides.end(); ++it) {
+      if (!setParameter(msg, it->first, it->second)) {
+        ROS_ERROR("%s : unknown parameter or wrong type : %s", key.c_str(), it->first.c_str());
+        return false;
+      }
+    }
+    if (!config.__fromMessage__(msg)) {
+      return false;
+    }
+    config.__clamp__();
+    return true;
+  }
+
+  static bool setParameter(dynamic_reconfigure::Config &msg, const std::string &name,
+                           XmlRpc::XmlRpcValue &value) {
+    for (size_t i = 0; i < msg.doubles.size(); ++i) {
+      if (msg.doubles[i].name == name) {
+        if (value.getType() == XmlRpc::XmlRpcValue::TypeDouble) {
+          msg.doubles[i].value = static_cast<double>(value);
+          return true;
+        } else if (value.getType() == XmlRpc::XmlRpcValue::TypeInt) {
+          msg.doubles[i].value = static_cast<int>(value);
+          return true;
+        }
+        return false;
+      }
+    }
+    for (size_t i = 0; i < msg.ints.size(); ++i) {
+      if (msg.ints[i].name == name) {
+        if (value.getType() != XmlRpc::XmlRpcValue::TypeInt) {
+          return false;
+        }
+        msg.ints[i].value = static_cast<int>(value);
+        return true;
+      }
+    }
+    for (size_t i = 0; i < msg.bools.size(); ++i) {
+      if (msg.bools[i].name == name) {
+        if (value.getType() != XmlRpc::XmlRpcValue::TypeBoolean) {
+          return false;
+        }
+        msg.bools[i].value = static_cast<bool>(value);
+        return true;
+      }
+    }
+    for (size_t i = 0; i < msg.strs.size(); ++i) {
+      if (msg.strs[i].name == name) {
+        if (value.getType() != XmlRpc::XmlRpcValue::TypeString) {
+          return false;
+        }
+        msg.strs[i].value = static_cast<std::string>(value);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  AreaProfile default_profile_;
+  std::vector<AreaProfile> profiles_; // area typeで引く
+  std::vector<bool> defined_;
+};
+
+#endif
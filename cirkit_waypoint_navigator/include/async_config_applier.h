@@ -0,0 +1,216 @@
+#ifndef ASYNC_CONFIG_APPLIER_H_
+#define ASYNC_CONFIG_APPLIER_H_
+
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <ros/serialization.h>
+#include <dynamic_reconfigure/client.h>
+#include <dynamic_reconfigure/Config.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <vector>
+
+/**
+ * dynamic_reconfigure client applying configs on its own thread.
+ * setConfig() returns at once; the config is compared with the last applied
+ * one and written only if it differs. Requests queued while a write is
+ * in flight are coalesced to the newest one.
+ * The server's current config is fetched as the default on construction.
+ */
+template <typename T>
+class AsyncConfigApplier {
+public:
+  typedef std::function<void(bool)> DoneCallback; // 適用できたか. workerのスレッドで呼ばれる
+
+  explicit AsyncConfigApplier(const std::string &name, double default_timeout = 5.0)
+    : name_(name), default_timeout_(default_timeout),
+      requested_at_(ros::WallTime::now()),
+      spinner_(1, &queue_), has_default_(false),
+      default_done_(false), shutdown_(false), has_applied_(false)
+  {
+    ros::NodeHandle nh;
+    nh.setCallbackQueue(&queue_); // parameter_updatesは制御ループと関係なく受け取る
+    // Clientはnhの子のNodeHandle(nh, name)を作るので, queue_がそのまま使われる
+    client_.reset(new dynamic_reconfigure::Client<T>(name, nh));
+    spinner_.start();
+    worker_ = std::thread(&AsyncConfigApplier::work, this);
+  }
+
+  ~AsyncConfigApplier() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shutdown_ = true;
+    }
+    cond_.notify_all();
+    worker_.join();
+    spinner_.stop();
+  }
+
+  AsyncConfigApplier(const AsyncConfigApplier&) = delete;
+  AsyncConfigApplier& operator=(const AsyncConfigApplier&) = delete;
+
+  // defaultのconfigが取れるまで待つ. 取れなかったときはhasDefault()がfalse
+  const T& loadDefault() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this]{ return default_done_; });
+    return default_config_;
+  }
+
+  bool hasDefault() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return has_default_;
+  }
+
+  // defaultを取りに行った時刻と取れた(諦めた)時刻. 後者はloadDefault()の後だけ有効
+  const ros::WallTime& defaultRequestedAt() const { return requested_at_; }
+  ros::WallTime defaultLoadedAt() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return loaded_at_;
+  }
+
+  std::shared_future<bool> setConfig(const T &config, DoneCallback done = DoneCallback()) {
+    return enqueue(config, false, done);
+  }
+
+  std::shared_future<bool> restoreToDefault(DoneCallback done = DoneCallback()) {
+    return enqueue(T(), true, done);
+  }
+
+  const std::string& name() const { return name_; }
+
+private:
+  struct Waiter {
+    std::promise<bool> promise;
+    DoneCallback done;
+  };
+
+  std::shared_future<bool> enqueue(const T &config, bool use_default, DoneCallback done) {
+    std::shared_ptr<Waiter> waiter(new Waiter);
+    waiter->done = done;
+    std::shared_future<bool> future = waiter->promise.get_future().share();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_config_ = config; // まだ書いていない古い要求は上書きする
+      pending_use_default_ = use_default;
+      waiters_.push_back(waiter);
+    }
+    cond_.notify_all();
+    return future;
+  }
+
+  static std::vector<uint8_t> serialize(const T &config) {
+    dynamic_reconfigure::Config msg;
+    config.__toMessage__(msg);
+    uint32_t size = ros::serialization::serializationLength(msg);
+    std::vector<uint8_t> buffer(size);
+    ros::serialization::OStream stream(buffer.data(), size);
+    ros::serialization::serialize(stream, msg);
+    return buffer;
+  }
+
+  void work() {
+    T current;
+    bool loaded = client_->getCurrentConfiguration(current, ros::Duration(default_timeout_));
+    if (loaded) {
+      ROS_INFO_STREAM("Default " << typeid(T).name() << " config cached from " << name_);
+    } else {
+      ROS_ERROR_STREAM("Could not load " << typeid(T).name() << " config from " << name_);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      default_config_ = current;
+      has_default_ = loaded;
+      default_done_ = true;
+      loaded_at_ = ros::WallTime::now();
+    }
+    cond_.notify_all();
+    if (loaded) { // サーバの今のconfigを書いたものとして扱う
+      applied_ = serialize(current);
+      has_applied_ = true;
+    }
+
+    while (true) {
+      T config;
+      std::vector<std::shared_ptr<Waiter> > waiters;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this]{ return shutdown_ || !waiters_.empty(); });
+        if (waiters_.empty()) {
+          return;
+        }
+        if (pending_use_default_ && !has_default_) {
+          ROS_ERROR_STREAM("No default " << typeid(T).name() << " config to restore");
+          waiters.swap(waiters_);
+          lock.unlock();
+          finish(waiters, false);
+          continue;
+        }
+        config = pending_use_default_ ? default_config_ : pending_config_;
+        waiters.swap(waiters_);
+      }
+
+      std::vector<uint8_t> target = serialize(config);
+      bool success = true;
+      if (has_applied_ && target.size() == applied_.size()
+          && memcmp(target.data(), applied_.data(), target.size()) == 0) {
+        ROS_DEBUG_STREAM(name_ << " config is unchanged, skipped.");
+      } else {
+        success = client_->setConfiguration(config);
+        if (success) {
+          applied_.swap(target);
+          has_applied_ = true;
+        } else {
+          ROS_ERROR_STREAM("Could not set " << typeid(T).name() << " config to " << name_);
+          has_applied_ = false; // サーバの状態が分からないので次は必ず書く
+        }
+      }
+      finish(waiters, success);
+    }
+  }
+
+  static void finish(std::vector<std::shared_ptr<Waiter> > &waiters, bool success) {
+    for (size_t i = 0; i < waiters.size(); ++i) {
+      waiters[i]->promise.set_value(success);
+      if (waiters[i]->done) {
+        waiters[i]->done(success);
+      }
+    }
+  }
+
+  std::string name_;
+  double default_timeout_;
+  ros::WallTime requested_at_;
+  ros::CallbackQueue queue_;
+  ros::AsyncSpinner spinner_;
+  std::unique_ptr<dynamic_reconfigure::Client<T> > client_;
+
+  // mutex_で守る
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  T default_config_;
+  bool has_default_;
+  T pending_config_;
+  bool pending_use_default_ = false;
+  std::vector<std::shared_ptr<Waiter> > waiters_;
+  bool default_done_;
+  ros::WallTime loaded_at_;
+  bool shutdown_;
+
+  // workerのスレッドだけで使う
+  std::vector<uint8_t> applied_; // 最後に書いたconfig
+  bool has_applied_;
+
+  std::thread worker_;
+};
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef FAKE_ROBOT_H_
+#define FAKE_ROBOT_H_
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/**
+ * Kinematic stand-in for move_base and the robot, used by fake_move_base.
+ * The robot turns toward the goal, drives at max_vel, aligns to the goal
+ * yaw and then succeeds. Every abort_every-th goal aborts after
+ * abort_after seconds and every stall_every-th goal never moves.
+ * It also keeps the numbers of the benchmark report: leg times and the
+ * reach latency, i.e. how long the robot stood at a goal before the
+ * next one arrived.
+ */
+class FakeRobot {
+public:
+  struct Params {
+    Params()
+      : max_vel(1.0), max_rot_vel(1.5), goal_tolerance(0.05), yaw_tolerance(0.1),
+        abort_every(0), abort_after(1.0), stall_every(0)
+    {}
+    double max_vel;        // [m/s]
+    double max_rot_vel;    // [rad/s]
+    double goal_tolerance; // [m]
+    double yaw_tolerance;  // [rad]
+    int abort_every;       // N個目ごとのgoalをabortする. 0 : しない
+    double abort_after;    // [s] goalを受けてからabortするまで
+    int stall_every;       // N個目ごとのgoalで動かなくなる. 0 : しない
+  };
+
+  enum Result {
+    IDLE,      // goalが無い
+    ACTIVE,    // goalに向かっている(止まっている場合も含む)
+    SUCCEEDED, // このstepで着いた
+    ABORTED    // このstepでabortした
+  };
+
+  FakeRobot()
+    : x_(0.0), y_(0.0), yaw_(0.0), goal_x_(0.0), goal_y_(0.0), goal_yaw_(0.0),
+      has_goal_(false), arrived_(false), goal_time_(0.0), arrived_time_(0.0),
+      goal_count_(0), leg_stalled_(false), leg_abort_(false), aborts_(0),
+      first_goal_time_(0.0)
+  {}
+
+  void setParams(const Params &params) {
+    params_ = params;
+  }
+
+  void setPose(double x, double y, double yaw) {
+    x_ = x;
+    y_ = y;
+    yaw_ = yaw;
+  }
+
+  void setGoal(double now, double x, double y, double yaw) {
+    if (goal_count_ == 0) {
+      first_goal_time_ = now;
+    }
+    if (has_goal_ || arrived_) {
+      leg_times_.push_back(now - goal_time_);
+      // 止まってから次のgoalが来るまで. 着く前に来たら0
+      reach_latencies_.push_back(arrived_ ? now - arrived_time_ : 0.0);
+    }
+    ++goal_count_;
+    goal_x_ = x;
+    goal_y_ = y;
+    goal_yaw_ = yaw;
+    goal_time_ = now;
+    has_goal_ = true;
+    arrived_ = false;
+    leg_abort_ = params_.abort_every > 0 && goal_count_ % params_.abort_every == 0;
+    leg_stalled_ = params_.stall_every > 0 && goal_count_ % params_.stall_every == 0;
+  }
+
+  void cancel() {
+    has_goal_ = false;
+  }
+
+  // 1刻み分ロボットを動かす
+  Result step(double now, double dt) {
+    if (!has_goal_) {
+      return IDLE;
+    }
+    if (leg_abort_ && now - goal_time_ > params_.abort_after) {
+      ++aborts_;
+      has_goal_ = false;
+      return ABORTED;
+    }
+    if (leg_stalled_) {
+      return ACTIVE;
+    }
+    double dx = goal_x_ - x_;
+    double dy = goal_y_ - y_;
+    double distance = sqrt(dx*dx + dy*dy);
+    if (distance > params_.goal_tolerance) {
+      double heading_error = normalize(atan2(dy, dx) - yaw_);
+      yaw_ = normalize(yaw_ + clamp(heading_error, params_.max_rot_vel * dt));
+      if (fabs(heading_error) < 0.5) { // ある程度前を向いたら進む
+        double v = std::min(params_.max_vel, distance / dt);
+        x_ += v * dt * cos(yaw_);
+        y_ += v * dt * sin(yaw_);
+      }
+      return ACTIVE;
+    }
+    double yaw_error = normalize(goal_yaw_ - yaw_);
+    yaw_ = normalize(yaw_ + clamp(yaw_error, params_.max_rot_vel * dt));
+    if (fabs(yaw_error) >= params_.yaw_tolerance) {
+      return ACTIVE;
+    }
+    has_goal_ = false;
+    arrived_ = true;
+    arrived_time_ = now;
+    return SUCCEEDED;
+  }
+
+  // 最後のgoalから何も来なくなってidle_timeout経ったか
+  bool finished(double now, double idle_timeout) const {
+    double idle_since = arrived_ ? arrived_time_ : goal_time_;
+    return goal_count_ > 0 && !has_goal_ && now - idle_since > idle_timeout;
+  }
+
+  // end_time : 最後のgoalが終わった時刻(sim), wall : 最初のgoalからの実時間 [s]
+  std::string report(double end_time, double wall) const {
+    double mission = end_time - first_goal_time_;
+    size_t legs = leg_times_.size() + (arrived_ ? 1 : 0);
+    double leg_sum = 0.0, leg_max = 0.0, latency_sum = 0.0, latency_max = 0.0;
+    size_t stops = 0;
+    for (size_t i = 0; i < leg_times_.size(); ++i) {
+      leg_sum += leg_times_[i];
+      leg_max = std::max(leg_max, leg_times_[i]);
+    }
+    for (size_t i = 0; i < reach_latencies_.size(); ++i) {
+      latency_sum += reach_latencies_[i];
+      latency_max = std::max(latency_max, reach_latencies_[i]);
+      if (reach_latencies_[i] > 0.0) {
+        ++stops;
+      }
+    }
+    char text[1024];
+    snprintf(text, sizeof(text),
+             "goals %d, legs %zu, aborts injected %d\n"
+             "mission time %.2f[s] (sim), %.2f[s] (wall), x%.1f\n"
+             "legs/sec %.3f (sim), %.3f (wall)\n"
+             "leg time mean %.3f[s], max %.3f[s]\n"
+             "reach latency mean %.3f[s], max %.3f[s], stopped at %zu of %zu waypoints\n"
+             "final pose %.3f %.3f %.3f\n",
+             goal_count_, legs, aborts_,
+             mission, wall, wall > 0.0 ? mission / wall : 0.0,
+             mission > 0.0 ? legs / mission : 0.0, wall > 0.0 ? legs / wall : 0.0,
+             leg_times_.empty() ? 0.0 : leg_sum / leg_times_.size(), leg_max,
+             reach_latencies_.empty() ? 0.0 : latency_sum / reach_latencies_.size(), latency_max,
+             stops, reach_latencies_.size(),
+             x_, y_, yaw_);
+    return text;
+  }
+
+  double x() const { return x_; }
+  double y() const { return y_; }
+  double yaw() const { return yaw_; }
+  bool hasGoal() const { return has_goal_; }
+  int goalCount() const { return goal_count_; }
+  int aborts() const { return aborts_; }
+  const std::vector<double>& legTimes() const { return leg_times_; }
+  const std::vector<double>& reachLatencies() const { return reach_latencies_; }
+
+  static double normalize(double angle) {
+    return atan2(sin(angle), cos(angle));
+  }
+
+private:
+  static double clamp(double value, double limit) {
+    return std::max(-limit, std::min(value, limit));
+  }
+
+  Params params_;
+  double x_;
+  double y_;
+  double yaw_;
+  double goal_x_;
+  double goal_y_;
+  double goal_yaw_;
+  bool has_goal_;
+  bool arrived_;
+  double goal_time_;
+  double arrived_time_;
+  int goal_count_;
+  bool leg_stalled_;
+  bool leg_abort_;
+  int aborts_;
+  double first_goal_time_;
+  std::vector<double> leg_times_;       // goalを受けてから次のgoalまで [s]
+  std::vector<double> reach_latencies_; // 着いてから次のgoalまで [s]
+};
+
+#endif
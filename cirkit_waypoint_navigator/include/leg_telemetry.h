@@ -0,0 +1,231 @@
+#ifndef LEG_TELEMETRY_H_
+#define LEG_TELEMETRY_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 1回の状態遷移の記録. binaryのlogにはこのまま書く
+struct LegEvent {
+  enum Kind {
+    LEG_START = 0, // goalを送った
+    LEG_END = 1    // そのgoalの結果が決まった
+  };
+  uint64_t stamp_ns;
+  int32_t kind;
+  int32_t waypoint_index;
+  int32_t state;          // RobotBehaviors::State
+  int32_t area_type;
+  int32_t retries;        // 同じwaypointをやり直した回数
+  float duration;         // [s] goalを送ってから
+  float distance_to_goal; // [m]
+  float travelled;        // [m] goalを送ってから走った距離
+  uint32_t reserved;
+};
+
+/**
+ * Fixed-size single-producer single-consumer queue without locks.
+ * push() never blocks; it returns false when the queue is full.
+ */
+template <typename T, size_t N>
+class SpscRing {
+public:
+  SpscRing() : head_(0), tail_(0) {}
+
+  bool push(const T &value) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t next = (tail + 1) % N;
+    if (next == head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    buffer_[tail] = value;
+    tail_.store(next, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &value) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = buffer_[head];
+    head_.store((head + 1) % N, std::memory_order_release);
+    return true;
+  }
+
+private:
+  T buffer_[N];
+  std::atomic<size_t> head_;
+  std::atomic<size_t> tail_;
+};
+
+/**
+ * Records LegEvents from the control loop into a lock-free ring.
+ * A background thread drains it, appends the events to a log file
+ * (CSV, or binary: 32-byte header then raw LegEvent records) and calls
+ * the summary callback for every LEG_END event.
+ */
+class LegTelemetry {
+public:
+  typedef std::function<void(const LegEvent&)> SummaryCallback; // writerのスレッドで呼ばれる
+
+  static const size_t kCapacity = 4096;
+
+  LegTelemetry()
+    : file_(NULL), binary_(false), dropped_(0), running_(false), stop_(false)
+  {}
+
+  ~LegTelemetry() {
+    stop();
+  }
+
+  LegTelemetry(const LegTelemetry&) = delete;
+  LegTelemetry& operator=(const LegTelemetry&) = delete;
+
+  void setStateNames(const std::vector<std::string> &names) {
+    state_names_ = names;
+  }
+
+  /**
+   * Start the writer. filename may be empty (no log file); binary selects
+   * the binary format instead of CSV. Returns false if the file can't be opened.
+   */
+  bool start(const std::string &filename, bool binary,
+             SummaryCallback summary, double flush_period = 0.5) {
+    stop();
+    binary_ = binary;
+    summary_ = summary;
+    flush_period_ = flush_period;
+    bool opened = true;
+    if (!filename.empty()) {
+      file_ = fopen(filename.c_str(), binary ? "wb" : "w");
+      if (file_) {
+        setvbuf(file_, NULL, _IOFBF, 1 << 16);
+        writeHeader();
+      } else {
+        opened = false;
+      }
+    }
+    stop_ = false;
+    running_ = true;
+    writer_ = std::thread(&LegTelemetry::work, this);
+    return opened;
+  }
+
+  // 残っているeventを書き出して止める
+  void stop() {
+    if (!running_) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cond_.notify_all();
+    writer_.join();
+    running_ = false;
+    if (file_) {
+      fclose(file_);
+      file_ = NULL;
+    }
+  }
+
+  // 制御ループから呼ぶ. 待たない
+  void record(const LegEvent &event) {
+    if (!ring_.push(event)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  uint64_t dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+  const char* stateName(int state) const {
+    if (state >= 0 && state < (int)state_names_.size()) {
+      return state_names_[state].c_str();
+    }
+    return "UNKNOWN";
+  }
+
+private:
+  void writeHeader() {
+    if (binary_) {
+      char header[32];
+      memset(header, 0, sizeof(header));
+      memcpy(header, "CWPTELEM", 8);
+      uint32_t version = 1;
+      uint32_t record_size = sizeof(LegEvent);
+      memcpy(header + 8, &version, 4);
+      memcpy(header + 12, &record_size, 4);
+      fwrite(header, 1, sizeof(header), file_);
+    } else {
+      fputs("stamp,kind,waypoint_index,state,area_type,retries,duration,distance_to_goal,travelled\n", file_);
+    }
+  }
+
+  void write(const LegEvent &event) {
+    if (!file_) {
+      return;
+    }
+    if (binary_) {
+      fwrite(&event, sizeof(event), 1, file_);
+    } else {
+      fprintf(file_, "%llu.%09llu,%s,%d,%s,%d,%d,%.3f,%.3f,%.3f\n",
+              (unsigned long long)(event.stamp_ns / 1000000000ULL),
+              (unsigned long long)(event.stamp_ns % 1000000000ULL),
+              event.kind == LegEvent::LEG_START ? "start" : "end",
+              event.waypoint_index, stateName(event.state), event.area_type,
+              event.retries, event.duration, event.distance_to_goal, event.travelled);
+    }
+  }
+
+  void work() {
+    while (true) {
+      bool stopping;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait_for(lock, std::chrono::duration<double>(flush_period_),
+                       [this]{ return stop_; });
+        stopping = stop_;
+      }
+      LegEvent event;
+      while (ring_.pop(event)) {
+        write(event);
+        if (event.kind == LegEvent::LEG_END && summary_) {
+          summary_(event);
+        }
+      }
+      if (file_) {
+        fflush(file_);
+      }
+      if (stopping) {
+        return;
+      }
+    }
+  }
+
+  SpscRing<LegEvent, kCapacity> ring_;
+  std::vector<std::string> state_names_;
+  FILE *file_;
+  bool binary_;
+  double flush_period_ = 0.5;
+  SummaryCallback summary_;
+  std::atomic<uint64_t> dropped_;
+  bool running_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool stop_;
+  std::thread writer_;
+};
+
+#endif
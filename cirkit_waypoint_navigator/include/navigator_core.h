@@ -0,0 +1,219 @@
+#ifndef NAVIGATOR_CORE_H_
+#define NAVIGATOR_CORE_H_
+
+#include <cirkit_waypoint_io/compiled_route.h>
+#include <cirkit_waypoint_io/route_spatial_index.h>
+#include <cirkit_waypoint_io/waypoint_csv.h>
+
+#include <string>
+#include <vector>
+
+#include "leg_telemetry.h"
+#include "progress_monitor.h"
+#include "target_object_grid.h"
+
+namespace RobotBehaviors {
+  enum State {
+    WAYPOINT_NAV,
+    DETECT_TARGET_NAV,
+    WAYPOINT_REACHED_GOAL,
+    DETECT_TARGET_REACHED_GOAL,
+    INIT_NAV,
+    WAYPOINT_NAV_PLANNING_ABORTED,
+    DETECT_TARGET_NAV_PLANNING_ABORTED,
+    WAITING_FLAG,
+    DETECT_MOVE_BASE_ABORTED, // when move_base report aborted.
+    RELOCALIZED // when /initialpose is given, resume from the nearest waypoint.
+  };
+
+  inline const char* name(State state) {
+    switch (state) {
+      case WAYPOINT_NAV: return "WAYPOINT_NAV";
+      case DETECT_TARGET_NAV: return "DETECT_TARGET_NAV";
+      case WAYPOINT_REACHED_GOAL: return "WAYPOINT_REACHED_GOAL";
+      case DETECT_TARGET_REACHED_GOAL: return "DETECT_TARGET_REACHED_GOAL";
+      case INIT_NAV: return "INIT_NAV";
+      case WAYPOINT_NAV_PLANNING_ABORTED: return "WAYPOINT_NAV_PLANNING_ABORTED";
+      case DETECT_TARGET_NAV_PLANNING_ABORTED: return "DETECT_TARGET_NAV_PLANNING_ABORTED";
+      case WAITING_FLAG: return "WAITING_FLAG";
+      case DETECT_MOVE_BASE_ABORTED: return "DETECT_MOVE_BASE_ABORTED";
+      case RELOCALIZED: return "RELOCALIZED";
+    }
+    return "UNKNOWN";
+  }
+}
+
+namespace cirkit_waypoint_navigator {
+
+struct Pose2D {
+  double x;
+  double y;
+  double yaw;
+};
+
+// ロボットの位置
+class PoseInterface {
+public:
+  virtual ~PoseInterface() {}
+  // 判定に使うロボットの位置. 分からない(古い)ときはfalse
+  virtual bool getPose(Pose2D &pose) = 0;
+  // [m/s] lookahead_timeを使うときだけ呼ばれる
+  virtual double linearVelocity() { return 0.0; }
+};
+
+// move_baseへのgoal
+class GoalInterface {
+public:
+  virtual ~GoalInterface() {}
+  virtual void sendWaypointGoal(int index) = 0;        // routeのindex番目のwaypoint
+  virtual void sendTargetGoal(const Pose2D &pose) = 0; // 探索対象に近づく位置
+  virtual void cancelGoal() = 0;
+  virtual bool isAborted() = 0;                        // 今のgoalをmove_baseがabortした
+};
+
+// area typeごとのmove_baseの設定
+class ConfigInterface {
+public:
+  virtual ~ConfigInterface() {}
+  virtual void applyAreaType(int area_type) = 0;
+};
+
+// それ以外に外とやりとりするもの. 何もしない実装つき
+class NavigatorHooks {
+public:
+  enum LogLevel { INFO, WARN, ERROR };
+  virtual ~NavigatorHooks() {}
+  virtual void getTargets(std::vector<Pose2D> &targets) { targets.clear(); } // 探索対象の認識結果
+  virtual bool isGoFlagSet() { return true; }                                 // 一時停止から進んでよいか
+  virtual void reportTargetReached(double x, double y) { (void)x; (void)y; }
+  virtual void backRecovery() {}                                              // 止まるまで戻ってこない
+  virtual void publishAreaType(int area_type) { (void)area_type; }
+  virtual void recordLegEvent(const LegEvent &event) { (void)event; }
+  virtual void log(LogLevel level, const std::string &message) { (void)level; (void)message; }
+};
+
+/**
+ * Waypoint navigation state machine without ROS.
+ * The node calls tick() with the current time whenever something may have
+ * changed (a pose, a move_base feedback/result, a timer); every decision of
+ * the navigator is taken there through the interfaces above.
+ */
+class NavigatorCore {
+public:
+  struct Params {
+    Params()
+      : dist_thres_to_target_object(1.8), target_search_distance(5.0),
+        target_approach_tolerance(1.0), approached_target_radius(5.0),
+        limit_of_approach_to_target(5), target_pause(5.0),
+        resume_heading_weight(1.0), resume_max_distance(5.0),
+        lookahead_distance(0.0), lookahead_time(0.0), back_recovery(false),
+        verbose_period(30.0), pose_lost_timeout(5.0)
+    {}
+    double dist_thres_to_target_object; // 探索対象にどれだけ近づいたらゴールとするか
+    double target_search_distance;      // この距離以内の探索対象だけ目指す
+    double target_approach_tolerance;   // 探索対象からこれだけ手前をgoalにする
+    double approached_target_radius;    // この距離以内の探索対象はアプローチ済みとみなす
+    int limit_of_approach_to_target;    // 1つの探索対象について何度までアプローチするか
+    double target_pause;                // [s] 探索対象に着いたら止まる時間
+    double resume_heading_weight;       // 最近傍waypointを選ぶときの向きの重み [m/rad]
+    double resume_max_distance;         // これより遠いwaypointからは再開しない
+    double lookahead_distance;          // [m] 次のgoalを先に送る距離
+    double lookahead_time;              // [s] 速度*この時間で届く距離で次のgoalを先に送る
+    bool back_recovery;                 // planningに失敗したら戻ってみる
+    double verbose_period;              // [s] 進んでいない間に報告する周期
+    double pose_lost_timeout;           // [s] ロボットの位置が分からないままこれだけ経ったらabort
+    ProgressMonitor::Params progress;
+  };
+
+  NavigatorCore(PoseInterface &pose, GoalInterface &goal,
+                ConfigInterface &config, NavigatorHooks &hooks);
+
+  void setParams(const Params &params);
+  const Params& params() const { return params_; }
+
+  void setRoute(const cirkit_waypoint_io::WaypointRecord *waypoints, size_t size);
+  const cirkit_waypoint_io::CompiledRoute& route() const { return route_; }
+
+  // 位置と向きから次に目指すwaypointを選ぶ. 遠すぎるときは-1
+  int selectResumeWaypoint(const Pose2D &pose);
+
+  // start_waypoint < 0 : 今の位置に一番近いwaypointから
+  void start(double now, int start_waypoint);
+  // 次のtickで今のgoalをやめてindexのwaypointから再開する
+  void relocalize(int index);
+
+  // falseを返したら終わり
+  bool tick(double now);
+
+  bool finished() const { return phase_ == FINISHED; }
+  RobotBehaviors::State state() const { return state_; }
+  int targetWaypointIndex() const { return target_waypoint_index_; }
+  int legCount() const { return leg_count_; }
+  const ProgressMonitor& progressMonitor() const { return progress_monitor_; }
+
+private:
+  enum Phase {
+    SELECT_GOAL,  // 次のgoalを決めて送る
+    DRIVING,      // goalに向かっている
+    TARGET_PAUSE, // 探索対象の前で止まっている
+    WAITING_FLAG, // GOのフラグ待ち
+    FINISHED
+  };
+
+  void selectGoal(double now);
+  void drive(double now);
+  void abortLeg(double now, const std::string &reason); // スタックなどでlegをやめてやり直す
+  void endLeg(double now);
+  void recordLegEvent(int kind, double now);
+  bool setTargetGoal(const Pose2D &target, const Pose2D &robot);
+  void setWaypointGoal(int index);
+  Pose2D getTargetApproachPosition(const Pose2D &target, const Pose2D &robot) const;
+  double getLegProgress(const Pose2D &robot, double distance_to_goal) const;
+  double getLookaheadDistance();
+  bool canChain() const;
+  bool isFinalGoal() const;
+  void log(NavigatorHooks::LogLevel level, const std::string &message) { hooks_.log(level, message); }
+
+  PoseInterface &pose_;
+  GoalInterface &goal_;
+  ConfigInterface &config_;
+  NavigatorHooks &hooks_;
+  Params params_;
+
+  cirkit_waypoint_io::CompiledRoute route_;
+  cirkit_waypoint_io::RouteSpatialIndex route_index_;
+
+  Phase phase_;
+  RobotBehaviors::State state_;
+  int target_waypoint_index_;   // 次に目指すウェイポイントのインデックス
+  int leg_waypoint_index_;      // 今のlegのwaypoint
+  int leg_area_type_;
+  int now_area_type_;
+  int relocalized_waypoint_index_;
+  double goal_x_;               // 到達判定に使うgoalの位置(探索対象のときは探索対象自体)
+  double goal_y_;
+  double reach_threshold_;      // 今セットされてるゴールへのしきい値
+  TargetObjectGrid approached_targets_;
+  int last_approached_target_id_;
+  int number_of_approached_to_target_;
+  std::vector<Pose2D> targets_; // getTargets()の作業領域
+
+  ProgressMonitor progress_monitor_;
+  double verbose_start_;
+  double pause_end_;
+
+  // telemetry
+  int leg_count_;
+  int last_leg_waypoint_index_;
+  int leg_retries_;
+  double leg_start_;
+  double leg_travelled_;
+  double leg_distance_to_goal_;
+  bool has_last_leg_pose_;
+  double pose_lost_since_; // 位置が取れなくなった時刻. 取れている間は負
+  Pose2D last_leg_pose_;
+};
+
+} // namespace cirkit_waypoint_navigator
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef PROGRESS_MONITOR_H_
+#define PROGRESS_MONITOR_H_
+
+#include <math.h>
+#include <stddef.h>
+
+/**
+ * Stall detector over a sliding time window of robot poses.
+ * Each update() takes the pose and a progress value that grows as the robot
+ * advances along the route (e.g. arc length). Over the window it estimates
+ * the progress rate, the travelled speed (linear and angular) and how much
+ * of the travel was back-and-forth (oscillation).
+ * The robot counts as stuck only while it is neither moving nor turning,
+ * or oscillating in place; a robot that moves but progresses slowly is not.
+ */
+class ProgressMonitor {
+public:
+  enum State {
+    WARMING_UP,  // windowの半分が溜まるまで
+    PROGRESSING, // ルートに沿って進んでいる
+    SLOW,        // 動いているが進みが遅い(回り道, その場回転など)
+    OSCILLATING, // 行ったり来たりしている
+    STALLED      // 動いていない
+  };
+
+  struct Params {
+    Params()
+      : window(10.0), min_progress_rate(0.05), min_velocity(0.02),
+        min_angular_velocity(0.1), max_oscillation(0.7),
+        stall_timeout(5.0), no_progress_timeout(60.0)
+    {}
+    double window;               // [s]
+    double min_progress_rate;    // [m/s] これ以上ならPROGRESSING
+    double min_velocity;         // [m/s] これ未満で
+    double min_angular_velocity; // [rad/s] これ未満ならSTALLED
+    double max_oscillation;      // 1 - 変位/移動距離 がこれより大きければOSCILLATING
+    double stall_timeout;        // [s] warm-upの後, STALLED/OSCILLATINGがこれだけ続いたらabort
+    double no_progress_timeout;  // [s] PROGRESSINGにならないままこれだけ経ったらabort
+  };
+
+  static const size_t kCapacity = 128;
+
+  ProgressMonitor()
+    : head_(0), count_(0), state_(WARMING_UP),
+      progress_rate_(0.0), velocity_(0.0), angular_velocity_(0.0), oscillation_(0.0),
+      now_(0.0), last_moving_time_(0.0), last_progress_time_(0.0)
+  {}
+
+  void setParams(const Params &params) {
+    params_ = params;
+  }
+
+  const Params& params() const {
+    return params_;
+  }
+
+  // 新しいgoalを送ったときに呼ぶ
+  void reset(double t) {
+    head_ = 0;
+    count_ = 0;
+    state_ = WARMING_UP;
+    progress_rate_ = velocity_ = angular_velocity_ = oscillation_ = 0.0;
+    now_ = last_moving_time_ = last_progress_time_ = t;
+  }
+
+  State update(double t, double x, double y, double yaw, double progress) {
+    Sample sample;
+    sample.t = t;
+    sample.x = x;
+    sample.y = y;
+    sample.yaw = yaw;
+    sample.progress = progress;
+    now_ = t;
+
+    // windowを半分の容量で分割した間隔より詰まっていれば最新のsampleを置き換える
+    double interval = params_.window / (kCapacity / 2);
+    if (count_ >= 2 && t - at(count_ - 2).t < interval) {
+      at(count_ - 1) = sample;
+    } else {
+      if (count_ == kCapacity) {
+        pop();
+      }
+      samples_[(head_ + count_) % kCapacity] = sample;
+      ++count_;
+    }
+    // window開始より前のsampleは1つだけ残す
+    while (count_ >= 2 && at(1).t <= t - params_.window) {
+      pop();
+    }
+
+    const Sample &oldest = at(0);
+    double dt = t - oldest.t;
+    if (dt < params_.window * 0.5) {
+      state_ = WARMING_UP;
+      return state_;
+    }
+    double path_length = 0.0;
+    double turned = 0.0;
+    for (size_t i = 1; i < count_; ++i) {
+      const Sample &a = at(i - 1);
+      const Sample &b = at(i);
+      path_length += hypot(b.x - a.x, b.y - a.y);
+      turned += fabs(atan2(sin(b.yaw - a.yaw), cos(b.yaw - a.yaw)));
+    }
+    double displacement = hypot(sample.x - oldest.x, sample.y - oldest.y);
+    progress_rate_ = (sample.progress - oldest.progress) / dt;
+    velocity_ = path_length / dt;
+    angular_velocity_ = turned / dt;
+    oscillation_ = path_length > 0.0 ? 1.0 - displacement / path_length : 0.0;
+
+    if (state_ == WARMING_UP) { // stall_timeoutはwarm-upが終わってから数える
+      last_moving_time_ = t;
+    }
+    bool moving = velocity_ >= params_.min_velocity;
+    bool turning = angular_velocity_ >= params_.min_angular_velocity;
+    if (!moving && !turning) {
+      state_ = STALLED;
+    } else if (progress_rate_ >= params_.min_progress_rate) {
+      state_ = PROGRESSING;
+    } else if (!turning && oscillation_ > params_.max_oscillation) {
+      state_ = OSCILLATING; // 位置のノイズだけで動いているように見えるときもここ
+    } else {
+      state_ = SLOW;
+    }
+    if (state_ == PROGRESSING) {
+      last_progress_time_ = t;
+    }
+    if (state_ == PROGRESSING || state_ == SLOW) {
+      last_moving_time_ = t;
+    }
+    return state_;
+  }
+
+  // 位置が取れないまま時間だけ進める. 状態は最後のupdate()のまま, timeoutは進む
+  void advance(double t) {
+    now_ = t;
+  }
+
+  bool shouldAbort() const {
+    return stuckTime() > params_.stall_timeout
+      || now_ - last_progress_time_ > params_.no_progress_timeout;
+  }
+
+  // STALLED/OSCILLATINGが続いている時間 [s]
+  double stuckTime() const {
+    if (state_ != STALLED && state_ != OSCILLATING) {
+      return 0.0;
+    }
+    return now_ - last_moving_time_;
+  }
+
+  State state() const { return state_; }
+  double progressRate() const { return progress_rate_; }
+  double velocity() const { return velocity_; }
+  double angularVelocity() const { return angular_velocity_; }
+  double oscillation() const { return oscillation_; }
+
+  static const char* stateName(State state) {
+    switch (state) {
+      case WARMING_UP: return "WARMING_UP";
+      case PROGRESSING: return "PROGRESSING";
+      case SLOW: return "SLOW";
+      case OSCILLATING: return "OSCILLATING";
+      case STALLED: return "STALLED";
+    }
+    return "UNKNOWN";
+  }
+
+private:
+  struct Sample {
+    double t;
+    double x;
+    double y;
+    double yaw;
+    double progress;
+  };
+
+  // 古い順にi番目
+  Sample& at(size_t i) { return samples_[(head_ + i) % kCapacity]; }
+
+  void pop() {
+    head_ = (head_ + 1) % kCapacity;
+    --count_;
+  }
+
+  Params params_;
+  Sample samples_[kCapacity];
+  size_t head_;
+  size_t count_;
+  State state_;
+  double progress_rate_;
+  double velocity_;
+  double angular_velocity_;
+  double oscillation_;
+  double now_;
+  double last_moving_time_;   // 最後にPROGRESSING/SLOWだった時刻
+  double last_progress_time_; // 最後にPROGRESSINGだった時刻
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef ROBOT_POSE_PROVIDER_H_
+#define ROBOT_POSE_PROVIDER_H_
+
+#include <ros/ros.h>
+#include <geometry_msgs/Pose.h>
+#include <geometry_msgs/TransformStamped.h>
+#include <tf/transform_datatypes.h>
+#include <tf2/exceptions.h>
+#include <tf2_ros/buffer.h>
+#include <tf2_ros/transform_listener.h>
+
+#include <math.h>
+#include <string>
+
+/**
+ * Robot pose from a tf2_ros::Buffer.
+ * Call update() once per control tick, then read the cached pose().
+ * When the lookup fails the last pose is kept and isStale() tells it.
+ */
+class RobotPoseProvider {
+public:
+  RobotPoseProvider(const std::string &global_frame = "map",
+                    const std::string &robot_frame = "base_link",
+                    double max_age = 0.5)
+    : global_frame_(global_frame), robot_frame_(robot_frame), max_age_(max_age),
+      listener_(buffer_), has_pose_(false),
+      linear_velocity_(0.0), angular_velocity_(0.0)
+  {}
+
+  void setFrames(const std::string &global_frame, const std::string &robot_frame) {
+    global_frame_ = global_frame;
+    robot_frame_ = robot_frame;
+    has_pose_ = false;
+  }
+
+  void setMaxAge(double max_age) {
+    max_age_ = max_age;
+  }
+  double maxAge() const { return max_age_; }
+
+  // One tf lookup. Returns false if it failed (the cached pose is kept).
+  bool update() {
+    geometry_msgs::TransformStamped transform;
+    try {
+      transform = buffer_.lookupTransform(global_frame_, robot_frame_, ros::Time(0));
+    } catch (tf2::TransformException &ex) {
+      ROS_ERROR_THROTTLE(1.0, "%s", ex.what());
+      return false;
+    }
+    if (has_pose_ && transform.header.stamp <= stamp_) {
+      return true; // 新しいtfはまだ来ていない
+    }
+    geometry_msgs::Pose pose;
+    pose.position.x = transform.transform.translation.x;
+    pose.position.y = transform.transform.translation.y;
+    pose.position.z = transform.transform.translation.z;
+    pose.orientation = transform.transform.rotation;
+
+    if (has_pose_) {
+      double dt = (transform.header.stamp - stamp_).toSec();
+      if (dt > 0.0) {
+        double dx = pose.position.x - pose_.position.x;
+        double dy = pose.position.y - pose_.position.y;
+        double dyaw = tf::getYaw(pose.orientation) - tf::getYaw(pose_.orientation);
+        linear_velocity_ = sqrt(dx*dx + dy*dy) / dt;
+        angular_velocity_ = atan2(sin(dyaw), cos(dyaw)) / dt;
+      }
+    }
+    pose_ = pose;
+    stamp_ = transform.header.stamp;
+    has_pose_ = true;
+    return true;
+  }
+
+  bool waitForPose(double timeout) {
+    return buffer_.canTransform(global_frame_, robot_frame_, ros::Time(0), ros::Duration(timeout))
+      && update();
+  }
+
+  bool hasPose() const { return has_pose_; }
+  const geometry_msgs::Pose& pose() const { return pose_; }
+  const ros::Time& stamp() const { return stamp_; }
+
+  // 最後に取れたposeの古さ [s]
+  double age() const {
+    return has_pose_ ? (ros::Time::now() - stamp_).toSec() : INFINITY;
+  }
+  bool isStale() const { return age() > max_age_; }
+
+  // 連続するposeから求めた速度 [m/s], [rad/s]
+  double linearVelocity() const { return linear_velocity_; }
+  double angularVelocity() const { return angular_velocity_; }
+
+  tf2_ros::Buffer& buffer() { return buffer_; }
+
+private:
+  std::string global_frame_;
+  std::string robot_frame_;
+  double max_age_;
+  tf2_ros::Buffer buffer_;
+  tf2_ros::TransformListener listener_;
+  bool has_pose_;
+  geometry_msgs::Pose pose_;
+  ros::Time stamp_;
+  double linear_velocity_;
+  double angular_velocity_;
+};
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef SCAN_ROI_COUNTER_H_
+#define SCAN_ROI_COUNTER_H_
+
+#include <math.h>
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * Counts laser beams hitting convex polygon ROIs, working on the raw ranges.
+ * The sin/cos of every beam is cached for the scan geometry, and each ROI
+ * is tested as a set of half-planes over plain arrays so the loops vectorize.
+ * A concave region can be given as several convex ROIs.
+ */
+class ScanRoiCounter {
+public:
+  ScanRoiCounter()
+    : angle_min_(0.0f), angle_increment_(0.0f)
+  {}
+
+  /**
+   * Add a convex polygon in the scan frame. Vertices go around it
+   * in either direction. Returns the ROI id, or -1 if it is not a convex
+   * polygon (concave or self-intersecting ones are rejected too).
+   */
+  int addPolygon(const std::vector<float> &xs, const std::vector<float> &ys) {
+    size_t n = xs.size();
+    if (n < 3 || ys.size() != n) {
+      return -1;
+    }
+    // 向きを符号付き面積で揃えて, 内側が a*x + b*y <= c になるようにする
+    double area = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+      size_t j = (i + 1) % n;
+      area += (double)xs[i] * ys[j] - (double)xs[j] * ys[i];
+    }
+    if (area == 0.0) {
+      return -1;
+    }
+    // 半平面の積で数えるので凸でないと広く数えてしまう.
+    // どの辺から見ても全部の頂点が内側(一直線上は可)にあれば凸. 凹みも辺の交差もここで落ちる
+    for (size_t i = 0; i < n; ++i) {
+      size_t j = (i + 1) % n;
+      double ex = (double)xs[j] - xs[i];
+      double ey = (double)ys[j] - ys[i];
+      for (size_t k = 0; k < n; ++k) {
+        double cross = ex * ((double)ys[k] - ys[i]) - ey * ((double)xs[k] - xs[i]);
+        if (cross * area < 0.0) {
+          return -1;
+        }
+      }
+    }
+    float sign = area > 0.0 ? 1.0f : -1.0f;
+    Roi roi;
+    for (size_t i = 0; i < n; ++i) {
+      size_t j = (i + 1) % n;
+      HalfPlane edge;
+      edge.a = sign * (ys[j] - ys[i]);
+      edge.b = sign * (xs[i] - xs[j]);
+      edge.c = edge.a * xs[i] + edge.b * ys[i];
+      roi.edges.push_back(edge);
+    }
+    rois_.push_back(roi);
+    return (int)rois_.size() - 1;
+  }
+
+  // 軸に平行な長方形
+  int addBox(float min_x, float min_y, float max_x, float max_y) {
+    std::vector<float> xs(4), ys(4);
+    xs[0] = min_x; ys[0] = min_y;
+    xs[1] = max_x; ys[1] = min_y;
+    xs[2] = max_x; ys[2] = max_y;
+    xs[3] = min_x; ys[3] = max_y;
+    return addPolygon(xs, ys);
+  }
+
+  void clearRois() {
+    rois_.clear();
+  }
+
+  size_t roiCount() const {
+    return rois_.size();
+  }
+
+  /**
+   * Count beams with range_min <= range <= range_max inside each ROI.
+   * counts must have roiCount() elements.
+   */
+  void count(float angle_min, float angle_increment,
+             const float *ranges, size_t size,
+             float range_min, float range_max, int *counts) {
+    updateTables(angle_min, angle_increment, size);
+    x_.resize(size);
+    y_.resize(size);
+    valid_.resize(size);
+    mask_.resize(size);
+    float *x = x_.data();
+    float *y = y_.data();
+    uint8_t *valid = valid_.data();
+    const float *cos_table = cos_.data();
+    const float *sin_table = sin_.data();
+    for (size_t i = 0; i < size; ++i) {
+      float r = ranges[i];
+      valid[i] = (r >= range_min) & (r <= range_max); // NaN, infは範囲外になる
+      x[i] = r * cos_table[i];
+      y[i] = r * sin_table[i];
+    }
+    uint8_t *mask = mask_.data();
+    for (size_t k = 0; k < rois_.size(); ++k) {
+      const std::vector<HalfPlane> &edges = rois_[k].edges;
+      for (size_t i = 0; i < size; ++i) {
+        mask[i] = valid[i];
+      }
+      for (size_t e = 0; e < edges.size(); ++e) {
+        const float a = edges[e].a;
+        const float b = edges[e].b;
+        const float c = edges[e].c;
+        for (size_t i = 0; i < size; ++i) {
+          mask[i] &= (uint8_t)(a * x[i] + b * y[i] <= c);
+        }
+      }
+      int sum = 0;
+      for (size_t i = 0; i < size; ++i) {
+        sum += mask[i];
+      }
+      counts[k] = sum;
+    }
+  }
+
+private:
+  struct HalfPlane {
+    float a;
+    float b;
+    float c;
+  };
+
+  struct Roi {
+    std::vector<HalfPlane> edges;
+  };
+
+  // scanの角度が変わったときだけ作り直す
+  void updateTables(float angle_min, float angle_increment, size_t size) {
+    if (cos_.size() == size && angle_min == angle_min_ && angle_increment == angle_increment_) {
+      return;
+    }
+    angle_min_ = angle_min;
+    angle_increment_ = angle_increment;
+    cos_.resize(size);
+    sin_.resize(size);
+    for (size_t i = 0; i < size; ++i) {
+      double angle = (double)angle_min + (double)angle_increment * i;
+      cos_[i] = (float)cos(angle);
+      sin_[i] = (float)sin(angle);
+    }
+  }
+
+  float angle_min_;
+  float angle_increment_;
+  std::vector<float> cos_;
+  std::vector<float> sin_;
+  std::vector<Roi> rois_;
+  // count()の作業領域
+  std::vector<float> x_;
+  std::vector<float> y_;
+  std::vector<uint8_t> valid_;
+  std::vector<uint8_t> mask_;
+};
+
+#endif
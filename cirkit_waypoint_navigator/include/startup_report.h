@@ -0,0 +1,70 @@
+#ifndef STARTUP_REPORT_H_
+#define STARTUP_REPORT_H_
+
+#include <ros/ros.h>
+
+#include <stdio.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Wall-clock timing of the startup phases, relative to construction.
+ * Phases may run concurrently and be added from any thread.
+ */
+class StartupReport {
+public:
+  StartupReport()
+    : origin_(ros::WallTime::now())
+  {}
+
+  const ros::WallTime& origin() const { return origin_; }
+
+  void add(const std::string &name, const ros::WallTime &begin, const ros::WallTime &end) {
+    Phase phase;
+    phase.name = name;
+    phase.begin = (begin - origin_).toSec();
+    phase.end = (end - origin_).toSec();
+    std::lock_guard<std::mutex> lock(mutex_);
+    phases_.push_back(phase);
+  }
+
+  // 今の時刻で0秒のphaseを足す
+  void mark(const std::string &name) {
+    ros::WallTime now = ros::WallTime::now();
+    add(name, now, now);
+  }
+
+  // 起動からの経過時間 [s]
+  double elapsed() const {
+    return (ros::WallTime::now() - origin_).toSec();
+  }
+
+  // "name begin end duration" [s] の行
+  std::string toString() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string text = "phase begin[s] end[s] duration[s]\n";
+    char line[128];
+    for (size_t i = 0; i < phases_.size(); ++i) {
+      const Phase &phase = phases_[i];
+      snprintf(line, sizeof(line), "%s %.3f %.3f %.3f\n", phase.name.c_str(),
+               phase.begin, phase.end, phase.end - phase.begin);
+      text += line;
+    }
+    return text;
+  }
+
+private:
+  struct Phase {
+    std::string name;
+    double begin;
+    double end;
+  };
+
+  ros::WallTime origin_;
+  mutable std::mutex mutex_;
+  std::vector<Phase> phases_;
+};
+
+#endif
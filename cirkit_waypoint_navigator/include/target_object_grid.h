@@ -0,0 +1,143 @@
+#ifndef TARGET_OBJECT_GRID_H_
+#define TARGET_OBJECT_GRID_H_
+
+#include <stdint.h>
+#include <math.h>
+
+#include <cmath>
+
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Spatial hash grid of approached target objects.
+ * Cell size equals the dedup radius, so contains() looks at 3x3 cells only.
+ */
+class TargetObjectGrid {
+public:
+  explicit TargetObjectGrid(double radius = 5.0)
+    : radius_(radius), size_(0)
+  {}
+
+  static constexpr double kMinRadius = 1e-3; // [m] これより小さいとcellの番号がint64_tに収まらない
+
+  // Change the dedup radius and rehash the objects.
+  // A radius below kMinRadius (or NaN) is rejected and the current one is kept.
+  bool setRadius(double radius) {
+    if (!validRadius(radius)) {
+      return false;
+    }
+    radius_ = radius;
+    cells_.clear();
+    for (size_t id = 0; id < objects_.size(); ++id) {
+      if (objects_[id].alive) {
+        cells_[cellKey(cellIndex(objects_[id].x), cellIndex(objects_[id].y))].push_back((int)id);
+      }
+    }
+    return true;
+  }
+
+  double radius() const {
+    return radius_;
+  }
+
+  static bool validRadius(double radius) {
+    return radius >= kMinRadius && !std::isinf(radius); // NaNもここで落ちる
+  }
+
+  // Returns the id to remove() it later.
+  int insert(double x, double y) {
+    Object object;
+    object.x = x;
+    object.y = y;
+    object.alive = true;
+    int id = (int)objects_.size();
+    objects_.push_back(object);
+    cells_[cellKey(cellIndex(x), cellIndex(y))].push_back(id);
+    ++size_;
+    return id;
+  }
+
+  bool remove(int id) {
+    if (id < 0 || id >= (int)objects_.size() || !objects_[id].alive) {
+      return false;
+    }
+    Object &object = objects_[id];
+    std::vector<int> &cell = cells_[cellKey(cellIndex(object.x), cellIndex(object.y))];
+    for (size_t i = 0; i < cell.size(); ++i) {
+      if (cell[i] == id) {
+        cell[i] = cell.back();
+        cell.pop_back();
+        break;
+      }
+    }
+    object.alive = false;
+    --size_;
+    return true;
+  }
+
+  // Is there an object within radius() from (x, y)?
+  bool contains(double x, double y) const {
+    const int64_t cx = cellIndex(x);
+    const int64_t cy = cellIndex(y);
+    const double radius_sq = radius_ * radius_;
+    for (int64_t i = cx - 1; i <= cx + 1; ++i) {
+      for (int64_t j = cy - 1; j <= cy + 1; ++j) {
+        std::unordered_map<uint64_t, std::vector<int> >::const_iterator it
+          = cells_.find(cellKey(i, j));
+        if (it == cells_.end()) {
+          continue;
+        }
+        for (size_t k = 0; k < it->second.size(); ++k) {
+          const Object &object = objects_[it->second[k]];
+          double dx = x - object.x;
+          double dy = y - object.y;
+          if (dx*dx + dy*dy < radius_sq) {
+            return true;
+          }
+        }
+      }
+    }
+    return false;
+  }
+
+  double x(int id) const {
+    return objects_[id].x;
+  }
+
+  double y(int id) const {
+    return objects_[id].y;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  void clear() {
+    objects_.clear();
+    cells_.clear();
+    size_ = 0;
+  }
+
+private:
+  struct Object {
+    double x;
+    double y;
+    bool alive;
+  };
+
+  int64_t cellIndex(double v) const {
+    return (int64_t)floor(v / radius_);
+  }
+
+  static uint64_t cellKey(int64_t cx, int64_t cy) {
+    return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy;
+  }
+
+  double radius_;
+  size_t size_;
+  std::vector<Object> objects_; // indexed by id
+  std::unordered_map<uint64_t, std::vector<int> > cells_;
+};
+
+#endif
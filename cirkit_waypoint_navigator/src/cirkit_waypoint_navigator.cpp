@@ -4,165 +4,66 @@ read_csv.cpp : https://gist.github.com/yoneken/5765597#file-read_csv-cpp
 -------------------------------------------------- */
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <ros/package.h>
 #include <actionlib/client/simple_action_client.h>
 #include <actionlib/client/simple_client_goal_state.h>
 #include <geometry_msgs/Pose.h>
+#include <geometry_msgs/PoseWithCovarianceStamped.h>
 #include <jsk_recognition_msgs/BoundingBox.h>
 #include <jsk_recognition_msgs/BoundingBoxArray.h>
-#include <laser_geometry/laser_geometry.h>
 #include <move_base_msgs/MoveBaseAction.h>
 #include <sensor_msgs/LaserScan.h>
-#include <sensor_msgs/PointCloud.h>
-#include <tf/transform_listener.h>
+#include <tf/transform_datatypes.h>
 #include <visualization_msgs/Marker.h>
+#include <cirkit_waypoint_navigator/LegSummary.h>
 #include <cirkit_waypoint_navigator/TeleportAbsolute.h>
-#include <dynamic_reconfigure/client.h>
 #include <boost/shared_array.hpp>
-#include <boost/tokenizer.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cirkit_waypoint_io/waypoint_binary.h>
 #include <dwa_local_planner/DWAPlannerConfig.h>
 #include <std_msgs/Int32.h>
+#include <std_msgs/String.h>
 #include <move_base/MoveBaseConfig.h>
 #include <costmap_2d/ObstaclePluginConfig.h>
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
+#include <future>
 #include <iostream>
 #include <sstream>
 #include <string>
 
 #include "ros_colored_msg.h" // FIXME: this header depend ROS, but exclude ros header. Now must be readed after #include"ros/ros.h"
+#include "area_profile_table.h"
+#include "async_config_applier.h"
 #include "getch.h"
 #include "kbhit.h"
+#include "leg_telemetry.h"
+#include "navigator_core.h"
+#include "robot_pose_provider.h"
+#include "scan_roi_counter.h"
+#include "startup_report.h"
 
 typedef actionlib::SimpleActionClient<move_base_msgs::MoveBaseAction> MoveBaseClient;
 
-typedef boost::tokenizer<boost::char_separator<char> > tokenizer;
-
-namespace RobotBehaviors {
-  enum State {
-    WAYPOINT_NAV,
-    DETECT_TARGET_NAV,
-    WAYPOINT_REACHED_GOAL,
-    DETECT_TARGET_REACHED_GOAL,
-    INIT_NAV,
-    WAYPOINT_NAV_PLANNING_ABORTED,
-    DETECT_TARGET_NAV_PLANNING_ABORTED,
-    WAITING_FLAG,
-    DETECT_MOVE_BASE_ABORTED // when move_base report aborted.
-  };
-}
-
-class WayPoint {
-public:
-  WayPoint();
-  WayPoint(move_base_msgs::MoveBaseGoal goal, int area_type, double reach_threshold)
-    : goal_(goal), area_type_(area_type), reach_threshold_(reach_threshold)
-  {}
-  ~WayPoint(){} // FIXME: Don't declare destructor!!
-  bool isSearchArea() {
-    if (area_type_ == 1) {
-      return true;
-    }else{
-      return false;
-    }
-  }
-  bool isStopArea(){
-    return area_type_ == 2;
-  }
-  bool isSlowDownArea(){
-    return area_type_ == 3;
-  }
-  bool isSpeedUpArea(){
-    return area_type_ == 4;
-  }
-  bool isLineUpArea(){
-    return area_type_ == 5;
-  }
-
-  int getAreaType(){
-    return area_type_;
-  }
-
-  move_base_msgs::MoveBaseGoal goal_;
-  int area_type_;
-  double reach_threshold_;
-};
-
-template <typename T>
-class DynamicConfig{
-public:
-  DynamicConfig(const std::string &name)
-  : config_client(name){}
-
-  T loadDefault(){
-    if(!default_config_loaded){
-      bool is_not_timeout =
-        config_client.getCurrentConfiguration(
-          default_config_cache, ros::Duration(5.0));
-
-      if(!is_not_timeout){
-        std::stringstream err_ss;
-        err_ss << "Could not load" << typeid(T).name() << "config" << std::endl;
-        ROS_ERROR("%s", err_ss.str().c_str());
-      }
-
-      default_config_loaded = true;
-      std::stringstream info_ss;
-      info_ss << "Default" << typeid(T).name() << "config cached." << std::endl;
-      ROS_INFO("%s", info_ss.str().c_str());
-    }
-    return default_config_cache;
-  }
-
-  void setConfig(const T &config){
-    bool success = config_client.setConfiguration(config);
-    if(!success){
-      std::stringstream err_ss;
-      err_ss << "Could not set" << typeid(T).name() << "config" << std::endl;
-      ROS_ERROR("%s", err_ss.str().c_str());
-    }
-    is_default = false;
-  }
-
-  void restoreToDefault(){
-    if(is_default){
-      return;
-    }
-    std::stringstream info_ss;
-    info_ss << typeid(T).name() << "config restored to default." << std::endl;
-    ROS_INFO("%s", info_ss.str().c_str());
-    bool success = config_client.setConfiguration(default_config_cache);
-    if(!success){
-      std::stringstream err_ss;
-      err_ss << "Could not set" << typeid(T).name() << "config" << std::endl;
-      ROS_ERROR("%s", err_ss.str().c_str());
-    }
-    is_default = true;
-    /**
-     * 現状,configを戻してまたそれを見に行っているので
-     * ここでspinOnce()して更新している
-     * slowDownMoveBaseSpeed()などで呼んでいるsaveDefaultMoveBaseConfig()
-     * をコンストラクタなどで一度だけ呼べれば以下はいらない(はず)
-     */
-    ros::Duration(0.1).sleep();
-    ros::spinOnce();
-  }
-
-private:
-  bool is_default{true};
-  bool default_config_loaded{false};
-  T default_config_cache{};
-  dynamic_reconfigure::Client<T> config_client;
-};
-
+using cirkit_waypoint_navigator::NavigatorCore;
+using cirkit_waypoint_navigator::NavigatorHooks;
+using cirkit_waypoint_navigator::Pose2D;
 
-class CirkitWaypointNavigator {
+// 判断はすべてNavigatorCoreで行い, このクラスはROSとのやりとりだけをする
+class CirkitWaypointNavigator
+  : public cirkit_waypoint_navigator::PoseInterface,
+    public cirkit_waypoint_navigator::GoalInterface,
+    public cirkit_waypoint_navigator::ConfigInterface,
+    public NavigatorHooks {
 public:
   CirkitWaypointNavigator()
-    : ac_("move_base", true),
-      rate_(10)
+    : ac_("move_base", false), // move_baseのcallbackもglobal queueで受ける(spinOnce/callAvailableで処理)
+      rate_(10),
+      detection_spinner_(1, &detection_queue_)
   {
-    robot_behavior_state_ = RobotBehaviors::INIT_NAV;
     std::string filename;
 
     ros::NodeHandle n("~");
@@ -170,27 +71,105 @@ public:
                          filename,
                          ros::package::getPath("cirkit_waypoint_navigator") + "/waypoints/garden_waypoints.csv"); // FIXME: Don't find!
 
-    n.param("dist_thres_to_target_object", dist_thres_to_target_object_, 1.8);
-    n.param("limit_of_approach_to_target", limit_of_approach_to_target_, 5);
-    n.param("start_waypoint", target_waypoint_index_, 0);
-    n.param("slowdown_speed", slowdown_speed_, 0.3);
-    n.param("speedup_speed", speedup_speed_, 0.8);
-    n.param("lineup_path_distance_bias", lineup_path_distance_bias_, 1.2);
+    NavigatorCore::Params params;
+    n.param("dist_thres_to_target_object", params.dist_thres_to_target_object, params.dist_thres_to_target_object);
+    n.param("approached_target_radius", params.approached_target_radius, params.approached_target_radius); // この距離以内の探索対象はアプローチ済みとみなす
+    if (!TargetObjectGrid::validRadius(params.approached_target_radius)) {
+      ROS_ERROR("approached_target_radius must be at least %g [m], got %g. Using %g.",
+                TargetObjectGrid::kMinRadius, params.approached_target_radius,
+                NavigatorCore::Params().approached_target_radius);
+      params.approached_target_radius = NavigatorCore::Params().approached_target_radius;
+    }
+    n.param("limit_of_approach_to_target", params.limit_of_approach_to_target, params.limit_of_approach_to_target);
+    n.param("start_waypoint", start_waypoint_, 0); // -1 : 現在位置に一番近いwaypointから
+    n.param("resume_heading_weight", params.resume_heading_weight, params.resume_heading_weight); // [m/rad]
+    n.param("resume_max_distance", params.resume_max_distance, params.resume_max_distance);
+    n.param("resume_on_initialpose", resume_on_initialpose_, true);
+    std::string global_frame, robot_frame;
+    double pose_max_age;
+    n.param<std::string>("global_frame", global_frame, "map");
+    n.param<std::string>("robot_frame", robot_frame, "base_link");
+    n.param("pose_max_age", pose_max_age, 0.5); // [s] これより古いtfは使わない
+    pose_provider_.setFrames(global_frame, robot_frame);
+    pose_provider_.setMaxAge(pose_max_age);
+    n.param("event_driven", event_driven_, false); // true : move_baseのfeedback/doneが来たらすぐ判定する
+    n.param("stall_check_period", stall_check_period_, 0.5); // [s] event_drivenのとき, イベントが無くても判定する周期
+    // 先読み: waypointにこの距離(または速度*時間)まで近づいたら止まらずに次のgoalを送る. 0で無効
+    n.param("lookahead_distance", params.lookahead_distance, params.lookahead_distance); // [m]
+    n.param("lookahead_time", params.lookahead_time, params.lookahead_time);             // [s]
+    ProgressMonitor::Params &progress_params = params.progress; // スタック判定
+    n.param("progress_window", progress_params.window, progress_params.window);
+    n.param("progress_min_rate", progress_params.min_progress_rate, progress_params.min_progress_rate);
+    n.param("progress_min_velocity", progress_params.min_velocity, progress_params.min_velocity);
+    n.param("progress_min_angular_velocity", progress_params.min_angular_velocity, progress_params.min_angular_velocity);
+    n.param("progress_max_oscillation", progress_params.max_oscillation, progress_params.max_oscillation);
+    n.param("stall_timeout", progress_params.stall_timeout, progress_params.stall_timeout);
+    n.param("no_progress_timeout", progress_params.no_progress_timeout, progress_params.no_progress_timeout);
+    n.param("pose_lost_timeout", params.pose_lost_timeout, params.pose_lost_timeout); // [s] 位置が分からないままこれだけ経ったらabort
+    n.param("back_recovery", params.back_recovery, params.back_recovery); // true : planningに失敗したら1m下がってみる
+    core_.setParams(params);
+    n.param("back_recovery_obstacle_threshold", back_recovery_obstacle_threshold_, 5);
+    this->loadBackRecoveryRois(n);
 
     ROS_INFO("[Waypoints file name] : %s", filename.c_str());
-    detect_target_objects_sub_ = nh_.subscribe("/recognized_result", 1, &CirkitWaypointNavigator::detectTargetObjectCallback, this);
+    n.param("detection_decimation", detection_decimation_, 1); // N個に1個だけ使う
+    n.param("detection_timeout", detection_timeout_, 0.0);     // [s] 0 : 古くなっても捨てない
+    detection_decimation_ = std::max(1, detection_decimation_);
+    // 認識結果は別スレッドで受け取り, 制御ループとはポインタの入れ替えだけでやりとりする
+    ros::SubscribeOptions detection_ops =
+      ros::SubscribeOptions::create<jsk_recognition_msgs::BoundingBoxArray>(
+        "/recognized_result", 1,
+        boost::bind(&CirkitWaypointNavigator::detectTargetObjectCallback, this, _1),
+        ros::VoidPtr(), &detection_queue_);
+    detect_target_objects_sub_ = nh_.subscribe(detection_ops);
+    detection_spinner_.start();
     detect_target_object_monitor_client_ = nh_.serviceClient<cirkit_waypoint_navigator::TeleportAbsolute>("third_robot_monitor_human_pose");
     next_waypoint_marker_pub_ = nh_.advertise<visualization_msgs::Marker>("/next_waypoint", 1);
     area_type_pub_ = nh_.advertise<std_msgs::Int32>("/area_type", 1);
+    startup_report_pub_ = n.advertise<std_msgs::String>("startup_report", 1, true);
+    leg_summary_pub_ = n.advertise<cirkit_waypoint_navigator::LegSummary>("leg_summary", 10);
+    this->startTelemetry(n);
+
+    // 起動時の待ち(waypointの読み込み, action server, 3つのdefault config)は並行して進める.
+    // defaultのconfigはdwa_dynamic_config_などが作られたときからそれぞれのスレッドで取りに行っている
     ROS_INFO("Reading Waypoints.");
-    readWaypoint(filename.c_str());
+    std::future<int> route_loaded = std::async(std::launch::async, [this, filename]() {
+        ros::WallTime begin = ros::WallTime::now();
+        int result = this->readWaypoint(filename);
+        startup_report_.add("route", begin, ros::WallTime::now());
+        return result;
+      });
     ROS_INFO("Waiting for action server to start.");
-    ac_.waitForServer();
-
+    ros::WallTime action_server_begin = ros::WallTime::now();
+    while (ros::ok() && !ac_.waitForServer(ros::Duration(0.1))) {
+      ros::spinOnce();
+    }
+    startup_report_.add("action_server", action_server_begin, ros::WallTime::now());
+    if (route_loaded.get() != 0) { // routeが無ければ走れない
+      ROS_ERROR_STREAM("No route to navigate, shutting down.");
+      ros::shutdown();
+      return;
+    }
+    if (resume_on_initialpose_) { // routeができてから受け付ける
+      initial_pose_sub_ = nh_.subscribe("/initialpose", 1, &CirkitWaypointNavigator::initialPoseCallback, this);
+    }
+    ROS_INFO("Building area profiles.");
+    this->buildAreaProfiles(n);
+    startup_report_.add("dwa_default", dwa_dynamic_config_.defaultRequestedAt(),
+                        dwa_dynamic_config_.defaultLoadedAt());
+    startup_report_.add("move_base_default", move_base_dynamic_config_.defaultRequestedAt(),
+                        move_base_dynamic_config_.defaultLoadedAt());
+    startup_report_.add("obstacles_default", obstacle_plugin_dynamic_config_.defaultRequestedAt(),
+                        obstacle_plugin_dynamic_config_.defaultLoadedAt());
+    startup_report_.mark("ready");
+    ROS_INFO_STREAM("Ready in " << startup_report_.elapsed() << "[s]");
   }
 
   ~CirkitWaypointNavigator() {
+    telemetry_.stop();
     this->cancelGoal();
+    detection_spinner_.stop();
+    detect_target_objects_sub_.shutdown();
   }
 
   void sendNewGoal(geometry_msgs::Pose pose) {
@@ -198,8 +177,50 @@ public:
     goal.target_pose.pose = pose;
     goal.target_pose.header.frame_id = "map";
     goal.target_pose.header.stamp = ros::Time::now();
-    ac_.sendGoal(goal);
-    now_goal_ = goal.target_pose.pose;
+    ac_.sendGoal(goal,
+                 MoveBaseClient::SimpleDoneCallback(),
+                 MoveBaseClient::SimpleActiveCallback(),
+                 boost::bind(&CirkitWaypointNavigator::goalFeedbackCallback, this, _1));
+    has_feedback_pose_ = false;
+    if (!startup_reported_) {
+      this->reportStartup();
+    }
+  }
+
+  // move_baseが制御周期ごとに返すロボットの位置
+  void goalFeedbackCallback(const move_base_msgs::MoveBaseFeedbackConstPtr &feedback) {
+    feedback_pose_ = feedback->base_position.pose;
+    feedback_stamp_ = feedback->base_position.header.stamp;
+    has_feedback_pose_ = true;
+  }
+
+  // event_drivenのときはfeedbackの位置を使う. feedbackがtfと同じpose_max_ageより古ければtfの位置
+  // tfはrun()で1tickに1回だけ引いてあるので, ここではキャッシュを見るだけ
+  // 使える位置が無いときはfalse
+  bool getRobotPoseForGoalCheck(geometry_msgs::Pose &pose) {
+    if (event_driven_ && has_feedback_pose_
+        && (ros::Time::now() - feedback_stamp_).toSec() <= pose_provider_.maxAge()) {
+      pose = feedback_pose_;
+      return true;
+    }
+    if (!pose_provider_.hasPose() || pose_provider_.isStale()) {
+      ROS_WARN_STREAM_THROTTLE(1.0, "Robot pose is stale (" << pose_provider_.age() << "[s])");
+      return false;
+    }
+    pose = pose_provider_.pose();
+    return true;
+  }
+
+  // 次の判定までのwait
+  // event_driven : move_baseのfeedback/done, /initialposeなどのcallbackが来たらすぐ戻る.
+  //                何も来なくてもstall_check_period_で戻ってスタック判定する
+  void waitForNavigationEvent() {
+    if (event_driven_) {
+      ros::getGlobalCallbackQueue()->callAvailable(ros::WallDuration(stall_check_period_));
+    } else {
+      rate_.sleep();
+      ros::spinOnce();
+    }
   }
 
   void sendNextWaypointMarker(const geometry_msgs::Pose waypoint,
@@ -222,143 +243,140 @@ public:
     next_waypoint_marker_pub_.publish(waypoint_marker);
   }
 
-  void cancelGoal() {
+  virtual void cancelGoal() {
     ROS_INFO("cancelGoal() is called !!");
     ac_.cancelGoal();
   }
 
   int readWaypoint(std::string filename) {
-    const int rows_num = 9; // x, y, z, Qx,Qy,Qz,Qw, area_type, reach_threshold
-    boost::char_separator<char> sep("," ,"", boost::keep_empty_tokens);
-    std::ifstream ifs(filename.c_str());
-    std::string line;
-    while (ifs.good()) {
-      getline(ifs, line);
-      if (line.empty()) break;
-      tokenizer tokens(line, sep);
-      std::vector<double> data;
-      tokenizer::iterator it = tokens.begin();
-      for (; it != tokens.end() ; ++it) {
-        std::stringstream ss;
-        double d;
-        ss << *it;
-        ss >> d;
-        data.push_back(d);
-      }
-      if (data.size() != rows_num) {
-        ROS_ERROR("Row size is mismatch!!");
-        return -1;
-      } else {
-        move_base_msgs::MoveBaseGoal waypoint;
-        waypoint.target_pose.pose.position.x    = data[0];
-        waypoint.target_pose.pose.position.y    = data[1];
-        waypoint.target_pose.pose.position.z    = data[2];
-        waypoint.target_pose.pose.orientation.x = data[3];
-        waypoint.target_pose.pose.orientation.y = data[4];
-        waypoint.target_pose.pose.orientation.z = data[5];
-        waypoint.target_pose.pose.orientation.w = data[6];
-        waypoints_.push_back(WayPoint(waypoint, (int)data[7], data[8]/2.0));
-      }
+    cirkit_waypoint_io::WaypointIoError error;
+    if (!waypoint_file_.open(filename, &error)) { // csv or binary(.wpb)
+      ROS_ERROR_STREAM("Could not read waypoints : " << error.toString());
+      return -1;
     }
+    core_.setRoute(waypoint_file_.data(), waypoint_file_.size());
+    ROS_INFO_STREAM(core_.route().size() << " waypoints, route length " << core_.route().totalLength() << "[m]");
     return 0;
   }
 
-  void detectTargetObjectCallback(const jsk_recognition_msgs::BoundingBoxArray::ConstPtr &target_objects_ptr) {
-    target_objects_ = *target_objects_ptr;
+  // waypointのPoseはgoalを送るときだけ作る
+  geometry_msgs::Pose getWaypointPose(int index) {
+    const cirkit_waypoint_io::WaypointRecord &record = waypoint_file_[index];
+    geometry_msgs::Pose pose;
+    pose.position.x    = record.x;
+    pose.position.y    = record.y;
+    pose.position.z    = record.z;
+    pose.orientation.x = record.qx;
+    pose.orientation.y = record.qy;
+    pose.orientation.z = record.qz;
+    pose.orientation.w = record.qw;
+    return pose;
   }
 
-  WayPoint getNextWaypoint() {
-    ROS_INFO_STREAM("Next Waypoint : " << target_waypoint_index_);
-    WayPoint next_waypoint = waypoints_[target_waypoint_index_];
-    target_waypoint_index_++;
-    return next_waypoint;
+  void initialPoseCallback(const geometry_msgs::PoseWithCovarianceStamped::ConstPtr &initial_pose) {
+    core_.relocalize(core_.selectResumeWaypoint(this->toPose2D(initial_pose->pose.pose)));
   }
 
-  bool isFinalGoal() {
-    if ((target_waypoint_index_) == ((int)waypoints_.size())) {
-      return true;
-    }else{
-      return false;
+  // detection_spinner_のスレッドで呼ばれる
+  void detectTargetObjectCallback(const jsk_recognition_msgs::BoundingBoxArray::ConstPtr &target_objects_ptr) {
+    if (++detection_count_ % (unsigned int)detection_decimation_ != 0) {
+      return;
     }
+    target_objects_received_ns_.store(ros::Time::now().toNSec());
+    boost::atomic_store(&target_objects_, target_objects_ptr);
   }
 
-  bool isAlreadyApproachedToTargetObject(jsk_recognition_msgs::BoundingBox target_object) {
-    for (int i = 0; i < approached_target_objects_.boxes.size(); ++i) {
-      double dist = calculateDistance(target_object.pose, approached_target_objects_.boxes[i].pose);
-      if (dist < 5.0) { // しきい値はパラメータサーバで設定できるようにする
-        return true;
+  // 最新の認識結果. 無いか古すぎるときはNULL
+  jsk_recognition_msgs::BoundingBoxArray::ConstPtr getTargetObjects() {
+    jsk_recognition_msgs::BoundingBoxArray::ConstPtr target_objects = boost::atomic_load(&target_objects_);
+    if (target_objects && detection_timeout_ > 0.0) {
+      double age = (int64_t)(ros::Time::now().toNSec() - target_objects_received_ns_.load()) * 1e-9;
+      if (age > detection_timeout_) {
+        return jsk_recognition_msgs::BoundingBoxArray::ConstPtr();
       }
     }
-    return false;
-  }
-
-  double calculateDistance(geometry_msgs::Pose a,geometry_msgs::Pose b) {
-    return sqrt(pow((a.position.x - b.position.x), 2.0) + pow((a.position.y - b.position.y), 2.0));
-  }
-
-  // 探索対象へのアプローチの場合
-  void setNextGoal(jsk_recognition_msgs::BoundingBox target_object, double threshold) {
-    reach_threshold_ = threshold;
-    // 現在のロボットの位置と探索対象を中心とした円の交点座標のロボットに近い方
-    geometry_msgs::Pose approach_pos = this->getTargetObjectApproachPosition(target_object.pose, 1.0);
-    approached_target_objects_.boxes.push_back(target_object);//探索済みに追加
-    this->sendNextWaypointMarker(approach_pos, 1);
-    this->sendNewGoal(approach_pos);
-    // move_baseに渡すgoalはgetTargetObjectApproachPosition()で計算した座標を渡すけど、
-    // 実際に探索対象に到達したかどうかの計算には探索対象自体の位置を使いたいから、
-    // now_goal_を実際の探索対象の位置で上書きする
-    now_goal_ = target_object.pose;
-  }
-
-  // 通常のwaypointの場合
-  void setNextGoal(WayPoint waypoint) {
-    reach_threshold_ = waypoint.reach_threshold_;
-    this->sendNextWaypointMarker(waypoint.goal_.target_pose.pose, 0); // 現在目指しているwaypointを表示する
-    this->sendNewGoal(waypoint.goal_.target_pose.pose);
-  }
-
-  double getReachThreshold() {
-    return reach_threshold_;
+    return target_objects;
+  }
+
+  double calculateDistance(const geometry_msgs::Pose &a, const geometry_msgs::Pose &b) {
+    double dx = a.position.x - b.position.x;
+    double dy = a.position.y - b.position.y;
+    return sqrt(dx*dx + dy*dy);
+  }
+
+  // ロボットの現在位置. tfを引くのはpose_provider_.update()だけで, ここでは1tick内のキャッシュを返す
+  const geometry_msgs::Pose& getRobotCurrentPosition() {
+    return pose_provider_.pose();
+  }
+
+  static Pose2D toPose2D(const geometry_msgs::Pose &pose) {
+    Pose2D pose2d;
+    pose2d.x = pose.position.x;
+    pose2d.y = pose.position.y;
+    pose2d.yaw = tf::getYaw(pose.orientation);
+    return pose2d;
+  }
+
+  // 後退するときに障害物を数える領域(scan_multiのframeの凸多角形).
+  // ~back_recovery_rois: [[[x, y], [x, y], ...], ...]. 無いときは従来の箱
+  void loadBackRecoveryRois(ros::NodeHandle &n) {
+    XmlRpc::XmlRpcValue rois;
+    if (n.getParam("back_recovery_rois", rois) && rois.getType() == XmlRpc::XmlRpcValue::TypeArray) {
+      for (int i = 0; i < rois.size(); ++i) {
+        std::vector<float> xs, ys;
+        bool valid = rois[i].getType() == XmlRpc::XmlRpcValue::TypeArray;
+        for (int j = 0; valid && j < rois[i].size(); ++j) {
+          XmlRpc::XmlRpcValue &point = rois[i][j];
+          valid = point.getType() == XmlRpc::XmlRpcValue::TypeArray && point.size() == 2
+            && isNumber(point[0]) && isNumber(point[1]);
+          if (valid) {
+            xs.push_back(this->toDouble(point[0]));
+            ys.push_back(this->toDouble(point[1]));
+          }
+        }
+        // 1点でもおかしければ, 途中までの点で別の領域を作らないようにROIごと使わない
+        if (!valid) {
+          ROS_ERROR("back_recovery_rois[%d] is not a list of [x, y] points, skipped", i);
+        } else if (back_recovery_counter_.addPolygon(xs, ys) < 0) {
+          std::ostringstream points;
+          for (size_t j = 0; j < xs.size(); ++j) {
+            points << (j == 0 ? "" : ", ") << "[" << xs[j] << ", " << ys[j] << "]";
+          }
+          ROS_ERROR_STREAM("back_recovery_rois[" << i << "] [" << points.str()
+                           << "] is not a convex polygon, skipped. Split a concave region into convex ROIs");
+        }
+      }
+    }
+    if (back_recovery_counter_.roiCount() == 0) {
+      back_recovery_counter_.addBox(0.2, 0.3, 0.7, 0.5);
+    }
+    back_recovery_counts_.assign(back_recovery_counter_.roiCount(), 0);
   }
 
-  geometry_msgs::Pose getRobotCurrentPosition() {
-    // tfを使ってロボットの現在位置を取得する
-    tf::StampedTransform transform;
-    geometry_msgs::Pose pose;
-    try {
-      listener_.lookupTransform("/map", "/base_link", ros::Time(0), transform);
-    } catch (tf::TransformException ex) {
-      ROS_ERROR("%s", ex.what());
-    }
-    pose.position.x = transform.getOrigin().x();
-    pose.position.y = transform.getOrigin().y();
-    //ROS_INFO_STREAM("c)x :" << pose.position.x << ", y :" << pose.position.y);
-    return pose;
+  static bool isNumber(XmlRpc::XmlRpcValue &value) {
+    return value.getType() == XmlRpc::XmlRpcValue::TypeInt
+      || value.getType() == XmlRpc::XmlRpcValue::TypeDouble;
   }
 
-  geometry_msgs::Pose getNowGoalPosition() {
-    //ROS_INFO_STREAM("g)x :" << now_goal_.position.x << ", y :" << now_goal_.position.y);
-    return now_goal_;
+  static double toDouble(XmlRpc::XmlRpcValue &value) {
+    if (value.getType() == XmlRpc::XmlRpcValue::TypeInt) {
+      return static_cast<int>(value);
+    }
+    return static_cast<double>(value);
   }
 
   void tryBackRecovery() {
     ROS_INFO_STREAM("Start tryBackRecovery()");
+    back_recovery_blocked_ = false;
     laser_scan_sub_ = nh_.subscribe("scan_multi", 1, &CirkitWaypointNavigator::laserCallback, this);
     cmd_vel_pub_ = nh_.advertise<geometry_msgs::Twist>("/cmd_vel", 1);
     geometry_msgs::Twist msg;
+    pose_provider_.update();
     geometry_msgs::Pose start_recovery_position = this->getRobotCurrentPosition(); // 現在座標
     ros::Time start_recovery_time = ros::Time::now();
     while (ros::ok()) {
       // 1m 下がる
-      int obstacle_counter = 0;
-      for (size_t i = 0; i < cloud_.points.size(); ++i) {
-        if (0.2 < cloud_.points[i].x && cloud_.points[i].x < 0.7) {
-          if (0.3 < cloud_.points[i].y && cloud_.points[i].y < 0.5) {
-            obstacle_counter++;
-          }
-        }
-      }
-      if(obstacle_counter > 5) {
+      if(back_recovery_blocked_) {
         msg.linear.x = 0;
         msg.angular.z = 0;
         cmd_vel_pub_.publish(msg);
@@ -367,7 +385,8 @@ public:
         msg.angular.z = 0;
         cmd_vel_pub_.publish(msg);
       }
-      geometry_msgs::Pose robot_current_position = this->getRobotCurrentPosition(); // 現在のロボットの座標
+      pose_provider_.update();
+      const geometry_msgs::Pose &robot_current_position = this->getRobotCurrentPosition(); // 現在のロボットの座標
       double delta_dist = this->calculateDistance(robot_current_position,
                                                   start_recovery_position); // 現在位置までの距離を計算
       if(delta_dist > 1.0) { // 1[m]後退したら終わり
@@ -386,15 +405,25 @@ public:
     cmd_vel_pub_.shutdown();
   }
 
+  // 点群にせずscanのままROIの中の点を数える
   void laserCallback(const sensor_msgs::LaserScan::ConstPtr& scan) {
-    projector_.projectLaser(*scan, cloud_);
+    back_recovery_counter_.count(scan->angle_min, scan->angle_increment,
+                                 scan->ranges.data(), scan->ranges.size(),
+                                 scan->range_min, scan->range_max,
+                                 back_recovery_counts_.data());
+    back_recovery_blocked_ = false;
+    for (size_t i = 0; i < back_recovery_counts_.size(); ++i) {
+      if (back_recovery_counts_[i] > back_recovery_obstacle_threshold_) {
+        back_recovery_blocked_ = true;
+      }
+    }
   }
 
-  void sendApproachedTargetPosition() {
-    jsk_recognition_msgs::BoundingBox approached_target_object = approached_target_objects_.boxes.back();
+  // NavigatorCoreから呼ばれる. 探索対象の位置をサーバに送る
+  virtual void reportTargetReached(double x, double y) {
     cirkit_waypoint_navigator::TeleportAbsolute srv_;
-    srv_.request.x = approached_target_object.pose.position.x;
-    srv_.request.y = approached_target_object.pose.position.y;
+    srv_.request.x = x;
+    srv_.request.y = y;
     srv_.request.theta = 0;
     if (detect_target_object_monitor_client_.call(srv_)) {
       ROS_INFO("Succeed to send target object position to server.");
@@ -403,325 +432,269 @@ public:
     }
   }
 
-  geometry_msgs::Pose getTargetObjectApproachPosition(geometry_msgs::Pose target_position, double tolerance)
-  {
-    geometry_msgs::Pose answers[2];
-    double distances[2];
-    geometry_msgs::Pose robot_position = this->getRobotCurrentPosition();
-    if ((robot_position.position.x - target_position.position.x)==0.0 ) {
-      answers[0].position.x = target_position.position.x;
-      answers[0].position.y = target_position.position.y + tolerance;
-      answers[1].position.x = target_position.position.x;
-      answers[1].position.y = target_position.position.y - tolerance;
-    } else {
-      double C = (target_position.position.y - robot_position.position.y)
-                 / (target_position.position.x - robot_position.position.x);
-      answers[0].position.x = target_position.position.x + tolerance/sqrt(1+pow(C, 2.0));
-      answers[0].position.y = target_position.position.y + (C*tolerance)/sqrt(1+pow(C, 2.0));
-      answers[1].position.x = target_position.position.x - tolerance/sqrt(1+pow(C, 2.0));
-      answers[1].position.y = target_position.position.y - (C*tolerance)/sqrt(1+pow(C, 2.0));
-    }
-    for (size_t i = 0; i < 2; ++i) {
-      answers[i].orientation = target_position.orientation;
-      distances[i] = this->calculateDistance(robot_position, answers[i]);
-    }
-    if (distances[0] < distances[1]) {
-      return answers[0];
-    } else {
-      return answers[1];
+  // event_drivenのときはfeedbackの位置を使ってtfを引かない
+  virtual bool getPose(Pose2D &pose) {
+    geometry_msgs::Pose robot_pose;
+    if (!this->getRobotPoseForGoalCheck(robot_pose)) {
+      return false;
     }
+    pose = this->toPose2D(robot_pose);
+    return true;
   }
 
-  void run() {
-    robot_behavior_state_ = RobotBehaviors::INIT_NAV;
-    number_of_approached_to_target_ = 0;
-    // this->saveDefaultMoveBaseConfig();
-    while (ros::ok()) {
-      bool is_set_next_as_target = false;
-      WayPoint next_waypoint = this->getNextWaypoint();
-      ROS_GREEN_STREAM("Next WayPoint is got");
-      if (next_waypoint.isSearchArea()) { // 次のwaypointが探索エリアがどうか判定
-        ROS_INFO_STREAM("Now Search area.");
-        if(target_objects_.boxes.size() > 0){ // 探索対象が見つかっているか
-          ROS_INFO_STREAM("Found target objects : " << target_objects_.boxes.size());
-          for (int i = 0; i < target_objects_.boxes.size(); ++i) {
-            if (! this->isAlreadyApproachedToTargetObject(target_objects_.boxes[i])) { // 探索対象にまだアプローチしていなかったら
-              //今の位置から5[m]以内なら目指す
-              geometry_msgs::Pose robot_pose = this->getRobotCurrentPosition();
-              geometry_msgs::Pose target_pose(target_objects_.boxes[i].pose);
-              double distance_to_target = this->calculateDistance(robot_pose, target_pose);
-              if (distance_to_target < 5.0) {
-                ROS_INFO_STREAM("Found new target object.");
-                this->setNextGoal(target_objects_.boxes[i], dist_thres_to_target_object_); // 探索対象を次のゴールに設定
-                ROS_INFO_STREAM("Set new target_objects as goal.");
-                robot_behavior_state_ = RobotBehaviors::DETECT_TARGET_NAV;
-                is_set_next_as_target = true;
-                break;
-              } else { // 探索対象が見つかったが遠すぎる
-                ROS_INFO_STREAM("Found new target object, but too far.");
-              }
-            }
-          }
-          if (! is_set_next_as_target) {
-            this->setNextGoal(next_waypoint);
-            robot_behavior_state_ = RobotBehaviors::WAYPOINT_NAV;
-            is_set_next_as_target = false;
-            ROS_INFO_STREAM("Valid target object isn't founded, hence next waypoint is set.");
-          }
-        } else { // 探索エリアだが探索対象がいない
-          ROS_INFO("Searching area but there are not target objects.");
-          this->setNextGoal(next_waypoint);
-          robot_behavior_state_ = RobotBehaviors::WAYPOINT_NAV;
-        }
-      } else { // 探索エリアではない
-        ROS_INFO("Go next_waypoint.");
-        this->setNextGoal(next_waypoint);
-        robot_behavior_state_ = RobotBehaviors::WAYPOINT_NAV;
-      }
-      ros::Time begin_navigation = ros::Time::now(); // 新しいナビゲーションを設定した時間
-      ros::Time verbose_start = ros::Time::now();
-      double last_distance_to_goal = 0;
-      double delta_distance_to_goal = 1.0; // 0.1[m]より大きければよい
-
-      // DWA, move_baseのconfigを変更
-      if (now_area_type_ != next_waypoint.getAreaType()) {
-        // waypointのtypeが切り替わったとき
-        dwa_dynamic_config_.restoreToDefault();
-        move_base_dynamic_config_.restoreToDefault();
-        obstacle_plugin_dynamic_config_.restoreToDefault();
-
-        if (next_waypoint.isSlowDownArea()){
-          this->slowDownMoveBaseSpeed();
-        }
-        if (next_waypoint.isSpeedUpArea()){
-          this->speedUpMoveBaseSpeed();
-        }
-        if (next_waypoint.isLineUpArea()){
-          this->lineUpModeMoveBase();
-        }
-        if (next_waypoint.isStopArea()){
-          this->slowDownMoveBaseSpeed();
-        }
-      }
-      now_area_type_ = next_waypoint.getAreaType();
+  virtual double linearVelocity() {
+    return pose_provider_.linearVelocity();
+  }
 
-      while (ros::ok()) {
-        geometry_msgs::Pose robot_current_position = this->getRobotCurrentPosition(); // 現在のロボットの座標
-        geometry_msgs::Pose now_goal_position = this->getNowGoalPosition(); // 現在目指している座標
-        double distance_to_goal = this->calculateDistance(robot_current_position, now_goal_position); // 現在位置とwaypointまでの距離を計算
-        // ここからスタック(Abort)判定。
+  virtual void sendWaypointGoal(int index) {
+    geometry_msgs::Pose pose = this->getWaypointPose(index);
+    this->sendNextWaypointMarker(pose, 0); // 現在目指しているwaypointを表示する
+    this->sendNewGoal(pose);
+  }
 
-        if(ac_.getState() == actionlib::SimpleClientGoalState::StateEnum::ABORTED){
-          robot_behavior_state_ = RobotBehaviors::DETECT_MOVE_BASE_ABORTED;
-          break;
-        }
+  virtual void sendTargetGoal(const Pose2D &approach) {
+    geometry_msgs::Pose pose;
+    pose.position.x = approach.x;
+    pose.position.y = approach.y;
+    pose.orientation = tf::createQuaternionMsgFromYaw(approach.yaw);
+    this->sendNextWaypointMarker(pose, 1);
+    this->sendNewGoal(pose);
+  }
 
-        delta_distance_to_goal = last_distance_to_goal - distance_to_goal; // どれだけ進んだか
-        if (delta_distance_to_goal < 0.1) { // 進んだ距離が0.1[m]より小さくて
-          ros::Duration how_long_stay_time = ros::Time::now() - begin_navigation;
-          if (how_long_stay_time.toSec() > 10.0 ) { // 90秒間経過していたら
-            if (robot_behavior_state_ == RobotBehaviors::WAYPOINT_NAV) {
-              robot_behavior_state_ = RobotBehaviors::WAYPOINT_NAV_PLANNING_ABORTED; // プランニング失敗とする
-              break;
-            } else if (robot_behavior_state_ == RobotBehaviors::DETECT_TARGET_NAV) {
-              robot_behavior_state_ = RobotBehaviors::DETECT_TARGET_NAV_PLANNING_ABORTED;
-              break;
-            } else {
-              break;
-            }
-          } else { // 30秒おきに進捗を報告する
-            ros::Duration verbose_time = ros::Time::now() - verbose_start;
-            if (verbose_time.toSec() > 30.0) {
-              ROS_INFO_STREAM("Waiting Abort: passed 30s, Distance to goal: " << distance_to_goal);
-              verbose_start = ros::Time::now();
-            }
-          }
-        } else { // 0.1[m]以上進んでいればOK
-          last_distance_to_goal = distance_to_goal;
-          begin_navigation = ros::Time::now();
-        }
-        // waypointの更新判定
-        if (distance_to_goal < this->getReachThreshold()) { // 目標座標までの距離がしきい値になれば
-          ROS_INFO_STREAM("Distance: " << distance_to_goal);
-          if (robot_behavior_state_ == RobotBehaviors::WAYPOINT_NAV) {
-            // add : 一時停止フラグ確認
-            if (next_waypoint.isStopArea()){
-              robot_behavior_state_ = RobotBehaviors::WAITING_FLAG;
-            } else {
-              robot_behavior_state_ = RobotBehaviors::WAYPOINT_REACHED_GOAL;
-            }
-            break;
-          } else if(robot_behavior_state_ == RobotBehaviors::DETECT_TARGET_NAV) {
-            robot_behavior_state_ = RobotBehaviors::DETECT_TARGET_REACHED_GOAL;
-            break;
-          } else {
-            break;
-          }
-        }
-        rate_.sleep();
-        ros::spinOnce();
-      }
+  virtual bool isAborted() {
+    return ac_.getState() == actionlib::SimpleClientGoalState::StateEnum::ABORTED;
+  }
 
+  // DWA, move_baseのconfigを変更. 書き込みは裏で行うので待たない
+  virtual void applyAreaType(int area_type) {
+    this->applyAreaProfile(area_type);
+  }
 
-      switch (robot_behavior_state_) {
-        case RobotBehaviors::WAYPOINT_REACHED_GOAL: {
-          ROS_INFO("WAYPOINT_REACHED_GOAL");
-          if (this->isFinalGoal()) { // そのwaypointが最後だったら
-            this->cancelGoal(); // ゴールをキャンセルして終了
-            return;
-          }
-          break;
-        }
-        case RobotBehaviors::DETECT_TARGET_REACHED_GOAL: {
-          ROS_INFO("DETECT_TARGET_REACHED_GOAL");
-          this->cancelGoal(); // 探索対象を見つけたらその場で停止して
-          ros::Duration(5.0).sleep(); // 5秒停止する
-          this->sendApproachedTargetPosition(); // サーバに探索対象の位置を送信する
-          // waypointを戻したりするべきかどうか
-          // アプローチ回数をリセットする
-          number_of_approached_to_target_ = 0;
-          target_waypoint_index_ -= 1;
-          break;
-        }
-        case RobotBehaviors::WAYPOINT_NAV_PLANNING_ABORTED: {
-          ROS_INFO("!! WAYPOINT_NAV_PLANNING_ABORTED !!");
-          this->cancelGoal(); // 今のゴールをキャンセルして
-          //this->tryBackRecovery(); // 1mくらい戻ってみて
-          target_waypoint_index_ -= 1; // waypoint indexを１つ戻す
-          break;
-        }
-        case RobotBehaviors::DETECT_TARGET_NAV_PLANNING_ABORTED: {
-          ROS_INFO("!! DETECT_TARGET_PLANNING_ABORTED !!");
-          this->cancelGoal(); // 今の探索対象をキャンセルして
-          if (number_of_approached_to_target_ > limit_of_approach_to_target_) {
-            // もし何度も同じ探索対象にアプローチしても到達出来なかったら
-            // 探索済みに追加したままにしてアプローチ回数をリセットする
-            number_of_approached_to_target_ = 0;
-          }else{
-            // アプローチ回数が一定値以下だったら、
-            // 最後に突っ込んだ探索済みとした探索対象を削除する
-            ROS_RED_STREAM("Faild to approach ... " << number_of_approached_to_target_ << "times");
-            approached_target_objects_.boxes.pop_back();
-            number_of_approached_to_target_ += 1;
-          }
-          target_waypoint_index_ -= 1; // waypoint indexを１つ戻す
-          break;
-        }
-        case RobotBehaviors::DETECT_MOVE_BASE_ABORTED: {
-          ROS_INFO("!! DETECT_MOVE_BASE_ABORTED !!");
-          //this->cancelGoal(); // 今のゴールをキャンセルして
-          //this->tryBackRecovery(); // 1mくらい戻ってみて
-          target_waypoint_index_ -= 1; // waypoint indexを１つ戻す
-          break;
-        }
-        case RobotBehaviors::WAITING_FLAG: {
-          ROS_INFO("WAITING FLAG... (Press [s] key)");
-          this->cancelGoal();
-          this->waitingFlag();
-          break;
-        }
-        default: {
-          ROS_WARN_STREAM("!! UNKNOWN STATE !!");
-          break;
-        }
-      }
-      publishAreaType(next_waypoint.getAreaType());
-      rate_.sleep();
-      ros::spinOnce();
-    } // while(ros::ok())
+  virtual void getTargets(std::vector<Pose2D> &targets) {
+    targets.clear();
+    jsk_recognition_msgs::BoundingBoxArray::ConstPtr target_objects = this->getTargetObjects();
+    if (!target_objects) {
+      return;
+    }
+    for (size_t i = 0; i < target_objects->boxes.size(); ++i) {
+      targets.push_back(this->toPose2D(target_objects->boxes[i].pose));
+    }
+  }
+
+  // GOのフラグ. 待たずにキーが押されたかだけ見る
+  virtual bool isGoFlagSet() {
+    return kbhit() && getche() == 's';
   }
 
-  // GOのフラグが来るまで待機
-  void waitingFlag() {
-    while(ros::ok()) {
-      if (kbhit() && getche() == 's') {
+  virtual void backRecovery() {
+    this->tryBackRecovery();
+  }
+
+  virtual void recordLegEvent(const LegEvent &event) {
+    telemetry_.record(event);
+  }
+
+  virtual void log(LogLevel level, const std::string &message) {
+    switch (level) {
+      case INFO: ROS_INFO_STREAM(message); break;
+      case WARN: ROS_WARN_STREAM(message); break;
+      case ERROR: ROS_ERROR_STREAM(message); break;
+    }
+  }
+
+  void run() {
+    if (!ros::ok()) { // 起動に失敗した
+      return;
+    }
+    int start_waypoint = start_waypoint_;
+    if (start_waypoint < 0) {
+      ros::WallTime begin = ros::WallTime::now();
+      pose_provider_.waitForPose(5.0);
+      startup_report_.add("robot_pose", begin, ros::WallTime::now());
+    }
+    pose_provider_.update(); // tfを引くのはtickの前の1回だけ. getPose()とlinearVelocity()はこれを読む
+    core_.start(ros::Time::now().toSec(), start_waypoint);
+    while (ros::ok()) {
+      this->waitForNavigationEvent();
+      pose_provider_.update();
+      if (!core_.tick(ros::Time::now().toSec())) {
         break;
       }
-      ros::spinOnce();
-      rate_.sleep();
     }
   }
 
-  // 減速
-  void slowDownMoveBaseSpeed(){
-    ROS_INFO("<-- dwa slow downed -->");
-    auto dwa_config = dwa_dynamic_config_.loadDefault();
-    dwa_config.max_vel_trans = slowdown_speed_;
-    dwa_config.max_vel_x = slowdown_speed_;
-    dwa_config.acc_lim_x = slowdown_speed_ * 5;
-    dwa_dynamic_config_.setConfig(dwa_config);
-  }
-  // 加速
-  void speedUpMoveBaseSpeed(){
-    ROS_INFO("<-- dwa speed up -->");
-    auto dwa_config = dwa_dynamic_config_.loadDefault();
-    dwa_config.max_vel_trans = speedup_speed_;
-    dwa_config.max_vel_x = speedup_speed_;
-    dwa_config.acc_lim_x = speedup_speed_ * 5;
-    dwa_dynamic_config_.setConfig(dwa_config);
-  }
-  // 待機列に並ぶためにpath_distance_biasを変更
-  void lineUpModeMoveBase(){
-    ROS_INFO("<-- dwa line up mode -->");
-    auto dwa_config = dwa_dynamic_config_.loadDefault();
-    dwa_config.max_vel_trans = slowdown_speed_;
-    dwa_config.max_vel_x = slowdown_speed_;
-    dwa_config.acc_lim_x = slowdown_speed_ * 5;
-    dwa_config.path_distance_bias = lineup_path_distance_bias_;
-    dwa_config.twirling_scale = 0.3;
-    dwa_dynamic_config_.setConfig(dwa_config);
-
-    auto move_base_config = move_base_dynamic_config_.loadDefault();
-    move_base_config.recovery_behavior_enabled = false; // When lining up, disable recovery.
-    move_base_dynamic_config_.setConfig(move_base_config);
-
-    // costmap_globalのobstacle_layerをfalseにするやつ(defaultはfalseなので影響ないハズ)
-    auto obstacle_plugin_config = obstacle_plugin_dynamic_config_.loadDefault();
-    obstacle_plugin_config.enabled = false;
-    obstacle_plugin_dynamic_config_.setConfig(obstacle_plugin_config);
+  // area typeごとのconfigを起動時に一度だけ作る.
+  // ~area_profilesが無いときは以前のslowdown_speedなどのパラメータから作る
+  void buildAreaProfiles(ros::NodeHandle &n) {
+    XmlRpc::XmlRpcValue profiles;
+    if (!n.getParam("area_profiles", profiles)) {
+      profiles = this->legacyAreaProfiles(n);
+    }
+    // 3つのdefaultはそれぞれのスレッドで並行して取ってきている
+    const dwa_local_planner::DWAPlannerConfig &dwa_default = dwa_dynamic_config_.loadDefault();
+    const move_base::MoveBaseConfig &move_base_default = move_base_dynamic_config_.loadDefault();
+    const costmap_2d::ObstaclePluginConfig &obstacles_default = obstacle_plugin_dynamic_config_.loadDefault();
+    ros::WallTime begin = ros::WallTime::now();
+    if (!area_profiles_.build(profiles, dwa_default, move_base_default, obstacles_default)) {
+      ROS_ERROR("Invalid area_profiles, every area type uses the default config.");
+      XmlRpc::XmlRpcValue empty;
+      empty.setSize(0);
+      area_profiles_.build(empty, dwa_default, move_base_default, obstacles_default);
+    }
+    startup_report_.add("area_profiles", begin, ros::WallTime::now());
+  }
+
+  XmlRpc::XmlRpcValue legacyAreaProfiles(ros::NodeHandle &n) {
+    double slowdown_speed, speedup_speed, lineup_path_distance_bias;
+    n.param("slowdown_speed", slowdown_speed, 0.3);
+    n.param("speedup_speed", speedup_speed, 0.8);
+    n.param("lineup_path_distance_bias", lineup_path_distance_bias, 1.2);
+    XmlRpc::XmlRpcValue profiles;
+    profiles.setSize(4);
+    const int area_types[4] = {2, 3, 4, 5}; // 停止, 減速, 加速, 待機列
+    const char *names[4] = {"stop", "slowdown", "speedup", "lineup"};
+    for (int i = 0; i < 4; ++i) {
+      double speed = (area_types[i] == 4) ? speedup_speed : slowdown_speed;
+      profiles[i]["area_type"] = area_types[i];
+      profiles[i]["name"] = std::string(names[i]);
+      profiles[i]["dwa"]["max_vel_trans"] = speed;
+      profiles[i]["dwa"]["max_vel_x"] = speed;
+      profiles[i]["dwa"]["acc_lim_x"] = speed * 5;
+    }
+    profiles[3]["dwa"]["path_distance_bias"] = lineup_path_distance_bias;
+    profiles[3]["dwa"]["twirling_scale"] = 0.3;
+    profiles[3]["move_base"]["recovery_behavior_enabled"] = false; // When lining up, disable recovery.
+    profiles[3]["obstacles"]["enabled"] = false;
+    return profiles;
+  }
+
+  // 作っておいたprofileに切り替える. defaultとの差分が無いものは書かれない
+  void applyAreaProfile(int area_type) {
+    const AreaProfile &profile = area_profiles_.profile(area_type);
+    ROS_INFO_STREAM("<-- " << profile.name << " -->");
+    AsyncConfigApplier<dwa_local_planner::DWAPlannerConfig>::DoneCallback done =
+      [area_type](bool success) {
+        if (!success) {
+          ROS_ERROR_STREAM("Failed to apply config of area type " << area_type);
+        }
+      };
+    if (dwa_dynamic_config_.hasDefault()) {
+      dwa_dynamic_config_.setConfig(profile.dwa, done);
+    }
+    if (move_base_dynamic_config_.hasDefault()) {
+      move_base_dynamic_config_.setConfig(profile.move_base, done);
+    }
+    if (obstacle_plugin_dynamic_config_.hasDefault()) {
+      obstacle_plugin_dynamic_config_.setConfig(profile.obstacles, done);
+    }
+  }
+
+  // 状態遷移ごとの記録. logへの書き出しとsummaryのpublishは別スレッド
+  void startTelemetry(ros::NodeHandle &n) {
+    std::string telemetry_file;
+    bool telemetry_binary;
+    n.param<std::string>("telemetry_file", telemetry_file, ""); // 空ならlogは書かない
+    n.param("telemetry_binary", telemetry_binary, false);        // false : csv
+    std::vector<std::string> names;
+    for (int state = 0; state <= RobotBehaviors::RELOCALIZED; ++state) {
+      names.push_back(RobotBehaviors::name((RobotBehaviors::State)state));
+    }
+    telemetry_.setStateNames(names);
+    if (!telemetry_.start(telemetry_file, telemetry_binary,
+                          boost::bind(&CirkitWaypointNavigator::publishLegSummary, this, _1))) {
+      ROS_ERROR("Could not open telemetry file : %s", telemetry_file.c_str());
+    }
+  }
+
+  // telemetry_のwriterのスレッドで呼ばれる
+  void publishLegSummary(const LegEvent &event) {
+    ++total_legs_;
+    if (event.state == RobotBehaviors::WAYPOINT_NAV_PLANNING_ABORTED
+        || event.state == RobotBehaviors::DETECT_TARGET_NAV_PLANNING_ABORTED
+        || event.state == RobotBehaviors::DETECT_MOVE_BASE_ABORTED) {
+      ++total_aborts_;
+    }
+    total_leg_duration_ += event.duration;
+    cirkit_waypoint_navigator::LegSummary msg;
+    msg.stamp.fromNSec(event.stamp_ns);
+    msg.waypoint_index = event.waypoint_index;
+    msg.area_type = event.area_type;
+    msg.result = telemetry_.stateName(event.state);
+    msg.duration = event.duration;
+    msg.travelled = event.travelled;
+    msg.distance_to_goal = event.distance_to_goal;
+    msg.retries = event.retries;
+    msg.total_legs = total_legs_;
+    msg.total_aborts = total_aborts_;
+    msg.total_duration = total_leg_duration_;
+    leg_summary_pub_.publish(msg);
+  }
+
+  // 起動から最初のgoalを送るまでの各phaseの時間をlogとtopicに出す
+  void reportStartup() {
+    startup_report_.mark("first_goal");
+    std_msgs::String msg;
+    msg.data = startup_report_.toString();
+    ROS_INFO_STREAM("Startup report\n" << msg.data);
+    startup_report_pub_.publish(msg);
+    startup_reported_ = true;
   }
 
   // nextwaypointのarea_typeをpublish
-  void publishAreaType(int area_type){
+  virtual void publishAreaType(int area_type){
     std_msgs::Int32 msg;
     msg.data = area_type;
     area_type_pub_.publish(msg);
   }
 
 private:
+  StartupReport startup_report_;          // 起動時間の計測. 他のメンバより先に作る
+  bool startup_reported_ = false;
+  ros::Publisher startup_report_pub_;
   MoveBaseClient ac_;
-  RobotBehaviors::State robot_behavior_state_;
   ros::Rate rate_;
-  std::vector<WayPoint> waypoints_;
+  cirkit_waypoint_io::WaypointFile waypoint_file_; // 読み込んだwaypoint(goalを作るときだけ参照)
+  NavigatorCore core_{*this, *this, *this, *this}; // 状態遷移とrouteはすべてここ
+  int start_waypoint_;
+  bool resume_on_initialpose_;
   ros::NodeHandle nh_;
-  tf::TransformListener listener_;
-  int target_waypoint_index_;             // 次に目指すウェイポイントのインデックス
-  jsk_recognition_msgs::BoundingBoxArray target_objects_;             //探索対象
-  jsk_recognition_msgs::BoundingBoxArray approached_target_objects_;  //アプローチ済みの探索対象
-  double dist_thres_to_target_object_;    // 探索対象にどれだけ近づいたらゴールとするか
-  double reach_threshold_;                // 今セットされてるゴール（waypointもしくは探索対象）へのしきい値
-  geometry_msgs::Pose now_goal_;          // 現在目指しているゴールの座標
-  int number_of_approached_to_target_;    // １つの探索対象について何度アプローチをしたか
-  int limit_of_approach_to_target_;       // 1つの探索対象について何度までアプローチするか
+  RobotPoseProvider pose_provider_;       // tf2で取ったロボットの位置(1tickに1回だけ引く)
+  jsk_recognition_msgs::BoundingBoxArray::ConstPtr target_objects_;   //探索対象(boost::atomic_load/storeでだけ触る)
+  std::atomic<uint64_t> target_objects_received_ns_{0};              //target_objects_を受け取った時刻
   ros::Subscriber laser_scan_sub_;
   ros::Subscriber detect_target_objects_sub_;
-  sensor_msgs::LaserScan scan_;
-  laser_geometry::LaserProjection projector_;
-  sensor_msgs::PointCloud cloud_;
+  ros::CallbackQueue detection_queue_;    // 認識結果専用のキュー
+  ros::AsyncSpinner detection_spinner_;
+  int detection_decimation_;
+  double detection_timeout_;
+  unsigned int detection_count_ = 0;      // detection_spinner_のスレッドだけで使う
+  ros::Subscriber initial_pose_sub_;
+  LegTelemetry telemetry_;                // legごとの記録
+  ros::Publisher leg_summary_pub_;
+  int total_legs_ = 0;                    // 以下3つはtelemetry_のwriterのスレッドだけで使う
+  int total_aborts_ = 0;
+  double total_leg_duration_ = 0.0;
+  int back_recovery_obstacle_threshold_;  // ROIの中の点がこれより多ければ止まる
+  ScanRoiCounter back_recovery_counter_;
+  std::vector<int> back_recovery_counts_; // ROIごとの点の数
+  bool back_recovery_blocked_ = false;
   ros::Publisher cmd_vel_pub_;
   ros::Publisher next_waypoint_marker_pub_;
   ros::Publisher area_type_pub_;
   ros::ServiceClient detect_target_object_monitor_client_;
   bool is_slowdown_ = false;
 
-  DynamicConfig<dwa_local_planner::DWAPlannerConfig> dwa_dynamic_config_{"/move_base/DWAPlannerROS"};
-  DynamicConfig<move_base::MoveBaseConfig> move_base_dynamic_config_{"/move_base"};
-  DynamicConfig<costmap_2d::ObstaclePluginConfig> obstacle_plugin_dynamic_config_{"/move_base/global_costmap/obstacles_laser"};
-
-  int now_area_type_ = -1;
-  double slowdown_speed_;
-  double speedup_speed_;
-  double lineup_path_distance_bias_;
+  // それぞれ別スレッドで書き込むので3つ同時に進む
+  AsyncConfigApplier<dwa_local_planner::DWAPlannerConfig> dwa_dynamic_config_{"/move_base/DWAPlannerROS"};
+  AsyncConfigApplier<move_base::MoveBaseConfig> move_base_dynamic_config_{"/move_base"};
+  AsyncConfigApplier<costmap_2d::ObstaclePluginConfig> obstacle_plugin_dynamic_config_{"/move_base/global_costmap/obstacles_laser"};
+  AreaProfileTable area_profiles_;        // area typeごとのconfig
+
+  bool event_driven_;
+  double stall_check_period_;
+  geometry_msgs::Pose feedback_pose_;     // move_baseのfeedbackのロボット位置
+  bool has_feedback_pose_ = false;        // 今のgoalでfeedbackを受け取ったか
+  ros::Time feedback_stamp_;              // feedback_pose_の時刻
 };
 
 int main(int argc, char** argv){
@@ -0,0 +1,254 @@
+/*-------------------------------------------------
+move_baseとtfの代わり(Gazeboなしでnavigatorを動かす)
+- move_baseのaction serverとして, goalに向かって運動学だけのロボットを動かす
+- map -> base_link のtfと /clock を出す(use_sim_timeで実時間より速く回せる)
+- 探索対象の検出, move_baseのabort, スタックを指定した割合で起こす
+- 最後にleg数/秒, 到達してから次のgoalが来るまでの時間, 全体の時間を報告する
+-------------------------------------------------- */
+
+#include <ros/ros.h>
+#include <actionlib/server/simple_action_server.h>
+#include <geometry_msgs/TransformStamped.h>
+#include <jsk_recognition_msgs/BoundingBoxArray.h>
+#include <move_base_msgs/MoveBaseAction.h>
+#include <rosgraph_msgs/Clock.h>
+#include <tf/transform_datatypes.h>
+#include <tf2_ros/transform_broadcaster.h>
+#include <cirkit_waypoint_io/waypoint_binary.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "fake_robot.h"
+
+typedef actionlib::SimpleActionServer<move_base_msgs::MoveBaseAction> MoveBaseServer;
+
+class FakeMoveBase {
+public:
+  FakeMoveBase()
+    : server_(nh_, "move_base", false)
+  {
+    ros::NodeHandle n("~");
+    FakeRobot::Params params;
+    n.param("max_vel", params.max_vel, params.max_vel);
+    n.param("max_rot_vel", params.max_rot_vel, params.max_rot_vel);
+    n.param("sim_rate", sim_rate_, 50.0);        // [Hz] シミュレーション時間での刻み
+    n.param("time_scale", time_scale_, 10.0);    // 実時間の何倍で回すか
+    n.param("goal_tolerance", params.goal_tolerance, params.goal_tolerance);
+    n.param("yaw_tolerance", params.yaw_tolerance, params.yaw_tolerance);
+    n.param("abort_every", params.abort_every, params.abort_every);
+    n.param("abort_after", params.abort_after, params.abort_after);
+    n.param("stall_every", params.stall_every, params.stall_every);
+    robot_.setParams(params);
+    n.param("detection_range", detection_range_, 5.0);
+    n.param("idle_timeout", idle_timeout_, 5.0); // [s] goalが来なくなってこれだけ経ったら終わり
+    n.param("shutdown_on_finish", shutdown_on_finish_, true);
+    n.param<std::string>("report_file", report_file_, "");
+    n.param<std::string>("global_frame", global_frame_, "map");
+    n.param<std::string>("robot_frame", robot_frame_, "base_link");
+    loadTargets(n);
+
+    // 最初のwaypointの位置から始める
+    std::string filename;
+    n.param<std::string>("waypointsfile", filename, "");
+    if (!filename.empty()) {
+      cirkit_waypoint_io::WaypointFile waypoints;
+      cirkit_waypoint_io::WaypointIoError error;
+      if (waypoints.open(filename, &error) && !waypoints.empty()) {
+        const cirkit_waypoint_io::WaypointRecord &start = waypoints[0];
+        robot_.setPose(start.x, start.y,
+                       atan2(2.0 * (start.qw * start.qz + start.qx * start.qy),
+                             1.0 - 2.0 * (start.qy * start.qy + start.qz * start.qz)));
+      } else {
+        ROS_ERROR_STREAM("Could not read waypoints : " << error.toString());
+      }
+    }
+
+    clock_pub_ = nh_.advertise<rosgraph_msgs::Clock>("/clock", 1);
+    detection_pub_ = nh_.advertise<jsk_recognition_msgs::BoundingBoxArray>("/recognized_result", 1);
+    server_.registerGoalCallback(boost::bind(&FakeMoveBase::goalCallback, this));
+    server_.registerPreemptCallback(boost::bind(&FakeMoveBase::preemptCallback, this));
+    server_.start();
+  }
+
+  // ~targets: [[x, y], ...] 探索対象の位置
+  void loadTargets(ros::NodeHandle &n) {
+    XmlRpc::XmlRpcValue targets;
+    if (!n.getParam("targets", targets) || targets.getType() != XmlRpc::XmlRpcValue::TypeArray) {
+      return;
+    }
+    for (int i = 0; i < targets.size(); ++i) {
+      if (targets[i].getType() != XmlRpc::XmlRpcValue::TypeArray || targets[i].size() != 2) {
+        ROS_ERROR("targets[%d] must be [x, y]", i);
+        continue;
+      }
+      targets_x_.push_back(toDouble(targets[i][0]));
+      targets_y_.push_back(toDouble(targets[i][1]));
+    }
+  }
+
+  static double toDouble(XmlRpc::XmlRpcValue &value) {
+    if (value.getType() == XmlRpc::XmlRpcValue::TypeInt) {
+      return static_cast<int>(value);
+    }
+    return static_cast<double>(value);
+  }
+
+  void goalCallback() {
+    const move_base_msgs::MoveBaseGoalConstPtr goal = server_.acceptNewGoal();
+    if (robot_.goalCount() == 0) {
+      first_goal_wall_ = ros::WallTime::now();
+    }
+    const geometry_msgs::Pose &pose = goal->target_pose.pose;
+    robot_.setGoal(sim_time_.toSec(), pose.position.x, pose.position.y, tf::getYaw(pose.orientation));
+  }
+
+  void preemptCallback() {
+    server_.setPreempted();
+    robot_.cancel();
+  }
+
+  // 1刻み分ロボットを動かす
+  void step(double dt) {
+    if (!server_.isActive()) {
+      return;
+    }
+    switch (robot_.step(sim_time_.toSec(), dt)) {
+      case FakeRobot::ABORTED:
+        server_.setAborted();
+        return;
+      case FakeRobot::SUCCEEDED:
+        server_.setSucceeded();
+        return;
+      case FakeRobot::IDLE:
+        return;
+      case FakeRobot::ACTIVE:
+        break;
+    }
+    move_base_msgs::MoveBaseFeedback feedback;
+    feedback.base_position.header.frame_id = global_frame_;
+    feedback.base_position.header.stamp = sim_time_;
+    feedback.base_position.pose = pose();
+    server_.publishFeedback(feedback);
+  }
+
+  geometry_msgs::Pose pose() const {
+    geometry_msgs::Pose pose;
+    pose.position.x = robot_.x();
+    pose.position.y = robot_.y();
+    pose.orientation = tf::createQuaternionMsgFromYaw(robot_.yaw());
+    return pose;
+  }
+
+  void publishTransform() {
+    geometry_msgs::TransformStamped transform;
+    transform.header.frame_id = global_frame_;
+    transform.header.stamp = sim_time_;
+    transform.child_frame_id = robot_frame_;
+    transform.transform.translation.x = robot_.x();
+    transform.transform.translation.y = robot_.y();
+    transform.transform.rotation = tf::createQuaternionMsgFromYaw(robot_.yaw());
+    br_.sendTransform(transform);
+  }
+
+  // detection_range_以内の探索対象を認識結果として出す
+  void publishDetections() {
+    jsk_recognition_msgs::BoundingBoxArray boxes;
+    boxes.header.frame_id = global_frame_;
+    boxes.header.stamp = sim_time_;
+    for (size_t i = 0; i < targets_x_.size(); ++i) {
+      if (hypot(targets_x_[i] - robot_.x(), targets_y_[i] - robot_.y()) > detection_range_) {
+        continue;
+      }
+      jsk_recognition_msgs::BoundingBox box;
+      box.header = boxes.header;
+      box.pose.position.x = targets_x_[i];
+      box.pose.position.y = targets_y_[i];
+      box.pose.orientation.w = 1.0;
+      box.dimensions.x = box.dimensions.y = 0.5;
+      box.dimensions.z = 1.7;
+      boxes.boxes.push_back(box);
+    }
+    detection_pub_.publish(boxes);
+  }
+
+  void run() {
+    sim_time_ = ros::Time(1.0); // 0はtfで「最新」の意味になるので避ける
+    double dt = 1.0 / sim_rate_;
+    ros::WallDuration wall_dt(time_scale_ > 0.0 ? dt / time_scale_ : 0.0);
+    int detection_decimation = std::max(1, (int)(sim_rate_ / 5.0)); // 5Hz
+    for (unsigned long tick = 0; ros::ok(); ++tick) {
+      ros::WallTime tick_start = ros::WallTime::now();
+      sim_time_ += ros::Duration(dt);
+      rosgraph_msgs::Clock clock;
+      clock.clock = sim_time_;
+      clock_pub_.publish(clock);
+      ros::spinOnce();
+      step(dt);
+      publishTransform();
+      if (!targets_x_.empty() && tick % detection_decimation == 0) {
+        publishDetections();
+      }
+      // 最後のgoalから何も来なくなったら終わり
+      if (robot_.finished(sim_time_.toSec(), idle_timeout_)) {
+        report(sim_time_.toSec() - idle_timeout_);
+        if (shutdown_on_finish_) {
+          ros::shutdown();
+        }
+        return;
+      }
+      ros::WallDuration rest = wall_dt - (ros::WallTime::now() - tick_start);
+      if (rest > ros::WallDuration(0)) {
+        rest.sleep();
+      }
+    }
+  }
+
+  void report(double end_time) {
+    std::string text = robot_.report(end_time, (ros::WallTime::now() - first_goal_wall_).toSec());
+    ROS_INFO_STREAM("Fake move_base report\n" << text);
+    if (!report_file_.empty()) {
+      FILE *file = fopen(report_file_.c_str(), "w");
+      if (file) {
+        fputs(text.c_str(), file);
+        fclose(file);
+      } else {
+        ROS_ERROR("Could not write report : %s", report_file_.c_str());
+      }
+    }
+  }
+
+private:
+  ros::NodeHandle nh_;
+  MoveBaseServer server_;
+  tf2_ros::TransformBroadcaster br_;
+  ros::Publisher clock_pub_;
+  ros::Publisher detection_pub_;
+  ros::Time sim_time_;
+
+  FakeRobot robot_;
+  double sim_rate_;
+  double time_scale_;
+  double detection_range_;
+  double idle_timeout_;
+  bool shutdown_on_finish_;
+  std::string report_file_;
+  std::string global_frame_;
+  std::string robot_frame_;
+  std::vector<double> targets_x_;
+  std::vector<double> targets_y_;
+
+  ros::WallTime first_goal_wall_;
+};
+
+int main(int argc, char** argv) {
+  ros::init(argc, argv, "fake_move_base");
+  FakeMoveBase fake_move_base;
+  fake_move_base.run();
+  return 0;
+}
@@ -0,0 +1,436 @@
+#include "navigator_core.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <sstream>
+
+namespace cirkit_waypoint_navigator {
+
+NavigatorCore::NavigatorCore(PoseInterface &pose, GoalInterface &goal,
+                             ConfigInterface &config, NavigatorHooks &hooks)
+  : pose_(pose), goal_(goal), config_(config), hooks_(hooks),
+    phase_(FINISHED), state_(RobotBehaviors::INIT_NAV),
+    target_waypoint_index_(0), leg_waypoint_index_(0), leg_area_type_(0),
+    now_area_type_(-1), relocalized_waypoint_index_(-1),
+    goal_x_(0.0), goal_y_(0.0), reach_threshold_(0.0),
+    last_approached_target_id_(-1), number_of_approached_to_target_(0),
+    verbose_start_(0.0), pause_end_(0.0),
+    leg_count_(0), last_leg_waypoint_index_(-1), leg_retries_(0),
+    leg_start_(0.0), leg_travelled_(0.0), leg_distance_to_goal_(0.0),
+    has_last_leg_pose_(false), pose_lost_since_(-1.0)
+{
+  setParams(params_);
+}
+
+void NavigatorCore::setParams(const Params &params) {
+  params_ = params;
+  if (!approached_targets_.setRadius(params_.approached_target_radius)) {
+    params_.approached_target_radius = approached_targets_.radius(); // 不正な値なら今の半径のまま
+  }
+  progress_monitor_.setParams(params_.progress);
+}
+
+void NavigatorCore::setRoute(const cirkit_waypoint_io::WaypointRecord *waypoints, size_t size) {
+  route_.compile(waypoints, size);
+  route_index_.build(route_);
+}
+
+int NavigatorCore::selectResumeWaypoint(const Pose2D &pose) {
+  int index = route_index_.resumeWaypoint(pose.x, pose.y, pose.yaw,
+                                          params_.resume_heading_weight);
+  if (index < 0) {
+    return -1;
+  }
+  int nearest = std::min(index, (int)route_.size() - 1);
+  double distance = sqrt(route_.distanceSquared(nearest, pose.x, pose.y));
+  std::ostringstream message;
+  if (distance > params_.resume_max_distance) {
+    message << "Nearest waypoint " << nearest << " is too far (" << distance << "[m])";
+    log(NavigatorHooks::WARN, message.str());
+    return -1;
+  }
+  message << "Resume from waypoint " << index << " (" << distance << "[m] away)";
+  log(NavigatorHooks::INFO, message.str());
+  return index;
+}
+
+void NavigatorCore::start(double now, int start_waypoint) {
+  state_ = RobotBehaviors::INIT_NAV;
+  number_of_approached_to_target_ = 0;
+  relocalized_waypoint_index_ = -1;
+  now_area_type_ = -1;
+  target_waypoint_index_ = start_waypoint;
+  if (target_waypoint_index_ < 0) {
+    int index = -1;
+    Pose2D pose;
+    if (pose_.getPose(pose)) {
+      index = selectResumeWaypoint(pose);
+    }
+    target_waypoint_index_ = std::max(0, std::min(index, (int)route_.size() - 1));
+  }
+  phase_ = SELECT_GOAL;
+  tick(now);
+}
+
+void NavigatorCore::relocalize(int index) {
+  relocalized_waypoint_index_ = index;
+}
+
+bool NavigatorCore::tick(double now) {
+  switch (phase_) {
+    case SELECT_GOAL:
+      selectGoal(now);
+      break;
+    case DRIVING:
+      drive(now);
+      break;
+    case TARGET_PAUSE:
+      if (now >= pause_end_) {
+        hooks_.reportTargetReached(approached_targets_.x(last_approached_target_id_),
+                                   approached_targets_.y(last_approached_target_id_)); // サーバに探索対象の位置を送信する
+        phase_ = SELECT_GOAL;
+      }
+      break;
+    case WAITING_FLAG:
+      if (hooks_.isGoFlagSet()) {
+        phase_ = SELECT_GOAL;
+      }
+      break;
+    case FINISHED:
+      break;
+  }
+  return phase_ != FINISHED;
+}
+
+void NavigatorCore::selectGoal(double now) {
+  if (target_waypoint_index_ < 0 || target_waypoint_index_ >= (int)route_.size()) {
+    phase_ = FINISHED;
+    return;
+  }
+  Pose2D robot;
+  bool has_pose = pose_.getPose(robot); // このtickのロボットの位置
+  int index = target_waypoint_index_++;
+  int area_type = route_.areaType(index);
+  leg_waypoint_index_ = index;
+  leg_area_type_ = area_type;
+  std::ostringstream message;
+  message << "Next Waypoint : " << index;
+  log(NavigatorHooks::INFO, message.str());
+
+  bool is_set_next_as_target = false;
+  if (area_type == 1) { // 次のwaypointが探索エリアなら探索対象を探す
+    hooks_.getTargets(targets_);
+    for (size_t i = 0; i < targets_.size() && has_pose; ++i) {
+      const Pose2D &target = targets_[i];
+      if (approached_targets_.contains(target.x, target.y)) { // アプローチ済み
+        continue;
+      }
+      if (hypot(robot.x - target.x, robot.y - target.y) < params_.target_search_distance) {
+        log(NavigatorHooks::INFO, "Found new target object.");
+        is_set_next_as_target = setTargetGoal(target, robot);
+        break;
+      } else { // 探索対象が見つかったが遠すぎる
+        log(NavigatorHooks::INFO, "Found new target object, but too far.");
+      }
+    }
+  }
+  if (is_set_next_as_target) {
+    state_ = RobotBehaviors::DETECT_TARGET_NAV;
+  } else {
+    setWaypointGoal(index);
+    state_ = RobotBehaviors::WAYPOINT_NAV;
+  }
+
+  progress_monitor_.reset(now); // 新しいナビゲーションを設定した時間
+  verbose_start_ = now;
+  leg_retries_ = (index == last_leg_waypoint_index_) ? leg_retries_ + 1 : 0;
+  last_leg_waypoint_index_ = index;
+  leg_start_ = now;
+  leg_travelled_ = 0.0;
+  leg_distance_to_goal_ = 0.0;
+  has_last_leg_pose_ = has_pose;
+  last_leg_pose_ = robot;
+  pose_lost_since_ = -1.0;
+  ++leg_count_;
+  recordLegEvent(LegEvent::LEG_START, now);
+
+  // DWA, move_baseのconfigを変更
+  if (now_area_type_ != area_type) {
+    config_.applyAreaType(area_type);
+  }
+  now_area_type_ = area_type;
+  phase_ = DRIVING;
+}
+
+void NavigatorCore::drive(double now) {
+  if (goal_.isAborted()) {
+    state_ = RobotBehaviors::DETECT_MOVE_BASE_ABORTED;
+    endLeg(now);
+    return;
+  }
+  if (relocalized_waypoint_index_ >= 0) {
+    state_ = RobotBehaviors::RELOCALIZED;
+    endLeg(now);
+    return;
+  }
+  Pose2D robot;
+  if (!pose_.getPose(robot)) { // 位置が分からない間は到達判定しない. timeoutだけ見る
+    if (pose_lost_since_ < 0.0) {
+      pose_lost_since_ = now;
+    }
+    progress_monitor_.advance(now);
+    if (now - pose_lost_since_ > params_.pose_lost_timeout) {
+      std::ostringstream message;
+      message << "Robot pose lost for " << now - pose_lost_since_ << "[s]";
+      abortLeg(now, message.str());
+    } else if (progress_monitor_.shouldAbort()) {
+      std::ostringstream message;
+      message << "Stuck (" << ProgressMonitor::stateName(progress_monitor_.state())
+              << "), robot pose lost";
+      abortLeg(now, message.str());
+    }
+    return;
+  }
+  pose_lost_since_ = -1.0;
+  double distance_to_goal = hypot(robot.x - goal_x_, robot.y - goal_y_);
+  leg_distance_to_goal_ = distance_to_goal;
+  if (has_last_leg_pose_) {
+    leg_travelled_ += hypot(robot.x - last_leg_pose_.x, robot.y - last_leg_pose_.y);
+  }
+  last_leg_pose_ = robot;
+  has_last_leg_pose_ = true;
+
+  // ここからスタック(Abort)判定
+  progress_monitor_.update(now, robot.x, robot.y, robot.yaw,
+                           getLegProgress(robot, distance_to_goal));
+  if (progress_monitor_.shouldAbort()) {
+    std::ostringstream message;
+    message << "Stuck (" << ProgressMonitor::stateName(progress_monitor_.state())
+            << "), Distance to goal: " << distance_to_goal;
+    abortLeg(now, message.str());
+    return;
+  }
+  if (progress_monitor_.state() != ProgressMonitor::PROGRESSING) { // 進んでいない間は定期的に報告する
+    if (now - verbose_start_ > params_.verbose_period) {
+      std::ostringstream message;
+      message << "Waiting Abort: " << ProgressMonitor::stateName(progress_monitor_.state())
+              << ", progress " << progress_monitor_.progressRate() << "[m/s]"
+              << ", velocity " << progress_monitor_.velocity() << "[m/s]"
+              << ", oscillation " << progress_monitor_.oscillation()
+              << ", Distance to goal: " << distance_to_goal;
+      log(NavigatorHooks::INFO, message.str());
+      verbose_start_ = now;
+    }
+  } else {
+    verbose_start_ = now;
+  }
+
+  // 先読み: 減速して止まる前に次のwaypointをmove_baseに送る
+  if (state_ == RobotBehaviors::WAYPOINT_NAV
+      && (params_.lookahead_distance > 0.0 || params_.lookahead_time > 0.0)
+      && canChain()
+      && distance_to_goal < getLookaheadDistance()) {
+    std::ostringstream message;
+    message << "Look-ahead, Distance: " << distance_to_goal;
+    log(NavigatorHooks::INFO, message.str());
+    state_ = RobotBehaviors::WAYPOINT_REACHED_GOAL;
+    endLeg(now);
+    return;
+  }
+  // waypointの更新判定
+  if (distance_to_goal < reach_threshold_) { // 目標座標までの距離がしきい値になれば
+    std::ostringstream message;
+    message << "Distance: " << distance_to_goal;
+    log(NavigatorHooks::INFO, message.str());
+    if (state_ == RobotBehaviors::WAYPOINT_NAV) {
+      if (leg_area_type_ == 2) { // 一時停止エリア
+        state_ = RobotBehaviors::WAITING_FLAG;
+      } else {
+        state_ = RobotBehaviors::WAYPOINT_REACHED_GOAL;
+      }
+    } else if (state_ == RobotBehaviors::DETECT_TARGET_NAV) {
+      state_ = RobotBehaviors::DETECT_TARGET_REACHED_GOAL;
+    }
+    endLeg(now);
+  }
+}
+
+void NavigatorCore::abortLeg(double now, const std::string &reason) {
+  log(NavigatorHooks::WARN, reason);
+  if (state_ == RobotBehaviors::WAYPOINT_NAV) {
+    state_ = RobotBehaviors::WAYPOINT_NAV_PLANNING_ABORTED; // プランニング失敗とする
+  } else if (state_ == RobotBehaviors::DETECT_TARGET_NAV) {
+    state_ = RobotBehaviors::DETECT_TARGET_NAV_PLANNING_ABORTED;
+  }
+  endLeg(now);
+}
+
+void NavigatorCore::endLeg(double now) {
+  recordLegEvent(LegEvent::LEG_END, now);
+  phase_ = SELECT_GOAL;
+  switch (state_) {
+    case RobotBehaviors::WAYPOINT_REACHED_GOAL: {
+      if (isFinalGoal()) { // そのwaypointが最後だったら
+        goal_.cancelGoal(); // ゴールをキャンセルして終了
+        phase_ = FINISHED;
+      }
+      break;
+    }
+    case RobotBehaviors::DETECT_TARGET_REACHED_GOAL: {
+      goal_.cancelGoal(); // 探索対象を見つけたらその場で停止して
+      pause_end_ = now + params_.target_pause; // しばらく止まってからサーバに位置を送る
+      phase_ = TARGET_PAUSE;
+      // アプローチ回数をリセットする
+      number_of_approached_to_target_ = 0;
+      target_waypoint_index_ -= 1;
+      break;
+    }
+    case RobotBehaviors::WAYPOINT_NAV_PLANNING_ABORTED: {
+      goal_.cancelGoal(); // 今のゴールをキャンセルして
+      if (params_.back_recovery) {
+        hooks_.backRecovery(); // 1mくらい戻ってみて
+      }
+      target_waypoint_index_ -= 1; // waypoint indexを１つ戻す
+      break;
+    }
+    case RobotBehaviors::DETECT_TARGET_NAV_PLANNING_ABORTED: {
+      goal_.cancelGoal(); // 今の探索対象をキャンセルして
+      if (number_of_approached_to_target_ > params_.limit_of_approach_to_target) {
+        // もし何度も同じ探索対象にアプローチしても到達出来なかったら
+        // 探索済みに追加したままにしてアプローチ回数をリセットする
+        number_of_approached_to_target_ = 0;
+      } else {
+        // アプローチ回数が一定値以下だったら、
+        // 最後に突っ込んだ探索済みとした探索対象を削除する
+        std::ostringstream message;
+        message << "Faild to approach ... " << number_of_approached_to_target_ << "times";
+        log(NavigatorHooks::WARN, message.str());
+        approached_targets_.remove(last_approached_target_id_);
+        number_of_approached_to_target_ += 1;
+      }
+      target_waypoint_index_ -= 1; // waypoint indexを１つ戻す
+      break;
+    }
+    case RobotBehaviors::DETECT_MOVE_BASE_ABORTED: {
+      if (params_.back_recovery) {
+        hooks_.backRecovery(); // 1mくらい戻ってみて
+      }
+      target_waypoint_index_ -= 1; // waypoint indexを１つ戻す
+      break;
+    }
+    case RobotBehaviors::RELOCALIZED: {
+      goal_.cancelGoal();
+      target_waypoint_index_ = relocalized_waypoint_index_;
+      relocalized_waypoint_index_ = -1;
+      if (isFinalGoal()) { // 最後のwaypointより先にいる
+        phase_ = FINISHED;
+      }
+      break;
+    }
+    case RobotBehaviors::WAITING_FLAG: {
+      log(NavigatorHooks::INFO, "WAITING FLAG... (Press [s] key)");
+      goal_.cancelGoal();
+      phase_ = WAITING_FLAG;
+      break;
+    }
+    default: {
+      log(NavigatorHooks::WARN, "!! UNKNOWN STATE !!");
+      break;
+    }
+  }
+  log(NavigatorHooks::INFO, RobotBehaviors::name(state_));
+  hooks_.publishAreaType(leg_area_type_);
+}
+
+void NavigatorCore::recordLegEvent(int kind, double now) {
+  LegEvent event;
+  memset(&event, 0, sizeof(event));
+  event.stamp_ns = (uint64_t)(now * 1e9);
+  event.kind = kind;
+  event.waypoint_index = leg_waypoint_index_;
+  event.state = state_;
+  event.area_type = leg_area_type_;
+  event.retries = leg_retries_;
+  event.duration = now - leg_start_;
+  event.distance_to_goal = leg_distance_to_goal_;
+  event.travelled = leg_travelled_;
+  hooks_.recordLegEvent(event);
+}
+
+// 探索対象へのアプローチの場合
+bool NavigatorCore::setTargetGoal(const Pose2D &target, const Pose2D &robot) {
+  reach_threshold_ = params_.dist_thres_to_target_object;
+  // 現在のロボットの位置と探索対象を中心とした円の交点座標のロボットに近い方
+  Pose2D approach = getTargetApproachPosition(target, robot);
+  last_approached_target_id_ = approached_targets_.insert(target.x, target.y); //探索済みに追加
+  goal_.sendTargetGoal(approach);
+  // move_baseに渡すgoalはapproachの座標だけど、
+  // 実際に探索対象に到達したかどうかの計算には探索対象自体の位置を使う
+  goal_x_ = target.x;
+  goal_y_ = target.y;
+  return true;
+}
+
+// 通常のwaypointの場合
+void NavigatorCore::setWaypointGoal(int index) {
+  reach_threshold_ = route_.reachThreshold(index);
+  goal_.sendWaypointGoal(index);
+  goal_x_ = route_.x(index);
+  goal_y_ = route_.y(index);
+}
+
+Pose2D NavigatorCore::getTargetApproachPosition(const Pose2D &target, const Pose2D &robot) const {
+  const double tolerance = params_.target_approach_tolerance;
+  Pose2D answers[2];
+  if ((robot.x - target.x) == 0.0) {
+    answers[0].x = target.x;
+    answers[0].y = target.y + tolerance;
+    answers[1].x = target.x;
+    answers[1].y = target.y - tolerance;
+  } else {
+    double C = (target.y - robot.y) / (target.x - robot.x);
+    answers[0].x = target.x + tolerance / sqrt(1 + C*C);
+    answers[0].y = target.y + (C*tolerance) / sqrt(1 + C*C);
+    answers[1].x = target.x - tolerance / sqrt(1 + C*C);
+    answers[1].y = target.y - (C*tolerance) / sqrt(1 + C*C);
+  }
+  answers[0].yaw = answers[1].yaw = target.yaw;
+  double d0 = hypot(robot.x - answers[0].x, robot.y - answers[0].y);
+  double d1 = hypot(robot.x - answers[1].x, robot.y - answers[1].y);
+  return d0 < d1 ? answers[0] : answers[1];
+}
+
+// 今のgoalに向かってどれだけ進んだか [m]. 大きいほど進んでいる.
+// waypointへは1つ前のwaypointからの区間に射影した道のり, 探索対象へは距離を減らした分
+double NavigatorCore::getLegProgress(const Pose2D &robot, double distance_to_goal) const {
+  int i = leg_waypoint_index_ - 1;
+  if (state_ != RobotBehaviors::WAYPOINT_NAV || i < 0) {
+    return -distance_to_goal;
+  }
+  double along = (robot.x - route_.x(i)) * route_.directionX(i)
+               + (robot.y - route_.y(i)) * route_.directionY(i);
+  along = std::max(0.0, std::min(along, route_.segmentLength(i)));
+  return route_.arcLength(i) + along;
+}
+
+// 次のgoalを先に送り始める距離
+double NavigatorCore::getLookaheadDistance() {
+  double distance = params_.lookahead_distance;
+  if (params_.lookahead_time > 0.0) {
+    distance = std::max(distance, pose_.linearVelocity() * params_.lookahead_time);
+  }
+  return distance;
+}
+
+// 止まる必要がないwaypointなら到達前に次のgoalへつないでよい
+bool NavigatorCore::canChain() const {
+  return leg_area_type_ != 2 && !isFinalGoal();
+}
+
+bool NavigatorCore::isFinalGoal() const {
+  return target_waypoint_index_ == (int)route_.size();
+}
+
+} // namespace cirkit_waypoint_navigator
@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+
+#include <math.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <cirkit_waypoint_io/waypoint_csv.h>
+
+#include "fake_robot.h"
+#include "navigator_core.h"
+
+using cirkit_waypoint_navigator::NavigatorCore;
+using cirkit_waypoint_navigator::NavigatorHooks;
+using cirkit_waypoint_navigator::Pose2D;
+
+namespace {
+
+// headless_benchmark.launchと同じ組み合わせ(NavigatorCore + fake_move_baseのFakeRobot)をプロセス内で回す.
+// ノードと同じく制御ループは10Hz, ロボットはsim_rate 50Hzで進める
+class HeadlessWorld
+  : public cirkit_waypoint_navigator::PoseInterface,
+    public cirkit_waypoint_navigator::GoalInterface,
+    public cirkit_waypoint_navigator::ConfigInterface,
+    public NavigatorHooks {
+public:
+  HeadlessWorld() : route(NULL), now(0.0), aborted(false) {}
+
+  virtual bool getPose(Pose2D &pose) {
+    pose.x = robot.x();
+    pose.y = robot.y();
+    pose.yaw = robot.yaw();
+    return true;
+  }
+  virtual double linearVelocity() {
+    return robot.hasGoal() ? params.max_vel : 0.0;
+  }
+
+  virtual void sendWaypointGoal(int index) {
+    aborted = false;
+    robot.setGoal(now, route->x(index), route->y(index), route->yaw(index));
+  }
+  virtual void sendTargetGoal(const Pose2D &pose) {
+    aborted = false;
+    robot.setGoal(now, pose.x, pose.y, pose.yaw);
+  }
+  virtual void cancelGoal() {
+    robot.cancel();
+  }
+  virtual bool isAborted() {
+    return aborted;
+  }
+
+  virtual void applyAreaType(int area_type) {
+    (void)area_type;
+  }
+
+  const cirkit_waypoint_io::CompiledRoute *route;
+  FakeRobot robot;
+  FakeRobot::Params params;
+  double now;
+  bool aborted;
+};
+
+class HeadlessBenchmarkTest : public ::testing::Test {
+protected:
+  HeadlessBenchmarkTest()
+    : core(world, world, world, world)
+  {}
+
+  void load(const std::string &filename) {
+    cirkit_waypoint_io::WaypointIoError error;
+    ASSERT_TRUE(cirkit_waypoint_io::readWaypointCsv(filename, records, &error)) << error.toString();
+    ASSERT_FALSE(records.empty());
+    core.setRoute(records.data(), records.size());
+    world.route = &core.route();
+    const cirkit_waypoint_io::WaypointRecord &start = records[0];
+    world.robot.setPose(start.x, start.y, core.route().yaw(0));
+  }
+
+  // event_driven : doneが来たらすぐ判定する(ノードのevent_driven). falseなら10Hzの周期だけ
+  std::string run(const NavigatorCore::Params &params, bool event_driven, double max_time = 3600.0) {
+    core.setParams(params);
+    world.robot.setParams(world.params);
+    const double dt = 1.0 / 50.0;
+    const int decimation = 5; // 10Hz
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    core.start(world.now, 0);
+    bool running = true;
+    for (long tick = 1; running && world.now < max_time; ++tick) {
+      world.now += dt;
+      FakeRobot::Result result = world.robot.step(world.now, dt);
+      if (result == FakeRobot::ABORTED) {
+        world.aborted = true;
+      }
+      bool event = event_driven && (result == FakeRobot::SUCCEEDED || result == FakeRobot::ABORTED);
+      if (tick % decimation == 0 || event) {
+        running = core.tick(world.now);
+      }
+    }
+    // fake_move_baseと同じく, 最後のgoalが終わるまで進めてから報告する
+    while (world.robot.hasGoal() && world.now < max_time) {
+      world.now += dt;
+      world.robot.step(world.now, dt);
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    finished = !running;
+    return world.robot.report(world.now, wall);
+  }
+
+  HeadlessWorld world;
+  NavigatorCore core;
+  std::vector<cirkit_waypoint_io::WaypointRecord> records;
+  bool finished = false;
+};
+
+const std::string kGazeboRoute = std::string(WAYPOINTS_DIR) + "/gazebo_waypoints.csv";
+
+TEST_F(HeadlessBenchmarkTest, GazeboRoutePolling)
+{
+  load(kGazeboRoute);
+  std::string report = run(NavigatorCore::Params(), false);
+  std::cout << "[ PERF     ] polling\n" << report;
+  EXPECT_TRUE(finished);
+  EXPECT_EQ((int)records.size(), world.robot.goalCount());
+}
+
+TEST_F(HeadlessBenchmarkTest, GazeboRouteEventDriven)
+{
+  load(kGazeboRoute);
+  std::string report = run(NavigatorCore::Params(), true);
+  std::cout << "[ PERF     ] event_driven\n" << report;
+  EXPECT_TRUE(finished);
+  EXPECT_EQ((int)records.size(), world.robot.goalCount());
+}
+
+TEST_F(HeadlessBenchmarkTest, GazeboRouteLookahead)
+{
+  load(kGazeboRoute);
+  NavigatorCore::Params params;
+  params.lookahead_distance = 2.0;
+  std::string report = run(params, false);
+  std::cout << "[ PERF     ] lookahead_distance 2.0\n" << report;
+  EXPECT_TRUE(finished);
+  EXPECT_EQ((int)records.size(), world.robot.goalCount());
+}
+
+TEST_F(HeadlessBenchmarkTest, GazeboRouteWithAbortsAndStalls)
+{
+  load(kGazeboRoute);
+  world.params.abort_every = 7;
+  world.params.stall_every = 11;
+  std::string report = run(NavigatorCore::Params(), false);
+  std::cout << "[ PERF     ] abort_every 7, stall_every 11\n" << report;
+  EXPECT_TRUE(finished);
+  EXPECT_GT(world.robot.aborts(), 0);
+  EXPECT_GT(world.robot.goalCount(), (int)records.size()); // やり直した分だけgoalが多い
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
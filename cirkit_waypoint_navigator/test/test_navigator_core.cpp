@@ -0,0 +1,449 @@
+#include <gtest/gtest.h>
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "navigator_core.h"
+
+using cirkit_waypoint_navigator::NavigatorCore;
+using cirkit_waypoint_navigator::NavigatorHooks;
+using cirkit_waypoint_navigator::Pose2D;
+
+namespace {
+
+// move_baseとロボットの代わり. goalに向かって一定速度でまっすぐ進む
+class FakeWorld
+  : public cirkit_waypoint_navigator::PoseInterface,
+    public cirkit_waypoint_navigator::GoalInterface,
+    public cirkit_waypoint_navigator::ConfigInterface,
+    public NavigatorHooks {
+public:
+  FakeWorld()
+    : route(NULL), speed(1.0), stuck(false), pose_lost(false), go_flag(true), abort_next(false),
+      leg_starts(0), leg_ends(0),
+      has_goal_(false), aborted_(false), goal_x_(0.0), goal_y_(0.0)
+  {
+    robot.x = robot.y = robot.yaw = 0.0;
+  }
+
+  void step(double dt) {
+    if (!has_goal_ || stuck) {
+      return;
+    }
+    double dx = goal_x_ - robot.x;
+    double dy = goal_y_ - robot.y;
+    double distance = hypot(dx, dy);
+    if (distance < 1e-9) {
+      return;
+    }
+    double move = std::min(distance, speed * dt);
+    robot.x += dx / distance * move;
+    robot.y += dy / distance * move;
+    robot.yaw = atan2(dy, dx);
+  }
+
+  virtual bool getPose(Pose2D &pose) {
+    pose = robot;
+    return !pose_lost;
+  }
+  virtual double linearVelocity() {
+    return (has_goal_ && !stuck) ? speed : 0.0;
+  }
+
+  virtual void sendWaypointGoal(int index) {
+    sent_waypoints.push_back(index);
+    setGoal(route->x(index), route->y(index));
+  }
+  virtual void sendTargetGoal(const Pose2D &pose) {
+    sent_targets.push_back(pose);
+    setGoal(pose.x, pose.y);
+  }
+  virtual void cancelGoal() {
+    has_goal_ = false;
+  }
+  virtual bool isAborted() {
+    return aborted_;
+  }
+
+  virtual void applyAreaType(int area_type) {
+    applied_area_types.push_back(area_type);
+  }
+
+  virtual void getTargets(std::vector<Pose2D> &result) {
+    result = targets;
+  }
+  virtual bool isGoFlagSet() {
+    return go_flag;
+  }
+  virtual void reportTargetReached(double x, double y) {
+    Pose2D pose = {x, y, 0.0};
+    reported_targets.push_back(pose);
+  }
+  virtual void recordLegEvent(const LegEvent &event) {
+    if (event.kind == LegEvent::LEG_START) {
+      ++leg_starts;
+    } else {
+      ++leg_ends;
+    }
+  }
+
+  const cirkit_waypoint_io::CompiledRoute *route;
+  Pose2D robot;
+  double speed;
+  bool stuck;
+  bool pose_lost; // getPose()が失敗する(tfが古い)
+  bool go_flag;
+  bool abort_next; // 次に送られたgoalをabortする
+  std::vector<Pose2D> targets;
+  std::vector<int> sent_waypoints;
+  std::vector<Pose2D> sent_targets;
+  std::vector<Pose2D> reported_targets;
+  std::vector<int> applied_area_types;
+  int leg_starts;
+  int leg_ends;
+
+private:
+  void setGoal(double x, double y) {
+    goal_x_ = x;
+    goal_y_ = y;
+    has_goal_ = true;
+    aborted_ = abort_next;
+    abort_next = false;
+  }
+
+  bool has_goal_;
+  bool aborted_;
+  double goal_x_;
+  double goal_y_;
+};
+
+// x軸に沿ってspacingおきのwaypoint
+std::vector<cirkit_waypoint_io::WaypointRecord> straightRoute(int size, double spacing) {
+  std::vector<cirkit_waypoint_io::WaypointRecord> records(size);
+  for (int i = 0; i < size; ++i) {
+    cirkit_waypoint_io::WaypointRecord &record = records[i];
+    record.x = (i + 1) * spacing;
+    record.y = 0.0;
+    record.z = 0.0;
+    record.qx = record.qy = record.qz = 0.0;
+    record.qw = 1.0;
+    record.reach_threshold = 0.5;
+    record.area_type = 0;
+    record.reserved = 0;
+  }
+  return records;
+}
+
+class NavigatorCoreTest : public ::testing::Test {
+protected:
+  NavigatorCoreTest()
+    : core(world, world, world, world), now(0.0)
+  {}
+
+  void setRoute(const std::vector<cirkit_waypoint_io::WaypointRecord> &records) {
+    core.setRoute(records.data(), records.size());
+    world.route = &core.route();
+  }
+
+  // 終わるかmax_time経つまで進める. 終わったらtrue
+  bool runFor(double max_time, double dt = 0.1) {
+    double end = now + max_time;
+    while (now < end) {
+      world.step(dt);
+      now += dt;
+      if (!core.tick(now)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  FakeWorld world;
+  NavigatorCore core;
+  double now;
+};
+
+TEST_F(NavigatorCoreTest, CompletesRouteInOrder)
+{
+  setRoute(straightRoute(10, 2.0));
+  core.start(now, 0);
+  ASSERT_TRUE(runFor(100.0));
+  ASSERT_EQ(10u, world.sent_waypoints.size());
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(i, world.sent_waypoints[i]);
+  }
+  EXPECT_EQ(world.leg_starts, world.leg_ends);
+  EXPECT_EQ(RobotBehaviors::WAYPOINT_REACHED_GOAL, core.state());
+  EXPECT_NEAR(20.0, world.robot.x, 0.5);
+}
+
+TEST_F(NavigatorCoreTest, EmptyRouteFinishesImmediately)
+{
+  setRoute(std::vector<cirkit_waypoint_io::WaypointRecord>());
+  core.start(now, -1);
+  EXPECT_TRUE(core.finished());
+  EXPECT_TRUE(world.sent_waypoints.empty());
+}
+
+TEST_F(NavigatorCoreTest, ResumesFromNearestWaypoint)
+{
+  setRoute(straightRoute(10, 2.0));
+  world.robot.x = 9.2; // waypoint 3(x=8)を過ぎたところ
+  core.start(now, -1);
+  ASSERT_FALSE(world.sent_waypoints.empty());
+  EXPECT_EQ(4, world.sent_waypoints[0]);
+}
+
+TEST_F(NavigatorCoreTest, RetriesAbortedWaypoint)
+{
+  setRoute(straightRoute(5, 2.0));
+  core.start(now, 0);
+  runFor(2.5); // waypoint 1に向かっている
+  ASSERT_EQ(2u, world.sent_waypoints.size());
+  world.abort_next = true;
+  runFor(2.0); // waypoint 2はabortされる
+  ASSERT_TRUE(runFor(100.0));
+  std::vector<int> expected = {0, 1, 2, 2, 3, 4};
+  EXPECT_EQ(expected, world.sent_waypoints);
+}
+
+TEST_F(NavigatorCoreTest, StuckRobotAbortsAndRetries)
+{
+  setRoute(straightRoute(5, 2.0));
+  core.start(now, 0);
+  runFor(1.0);
+  world.stuck = true;
+  runFor(20.0);
+  EXPECT_GT(world.sent_waypoints.size(), 1u);
+  EXPECT_EQ(0, world.sent_waypoints.back()); // 同じwaypointをやり直している
+  world.stuck = false;
+  EXPECT_TRUE(runFor(100.0));
+}
+
+TEST_F(NavigatorCoreTest, StallTimeoutStartsAfterWarmUp)
+{
+  NavigatorCore::Params params;
+  params.progress.window = 10.0;
+  params.progress.stall_timeout = 5.0;
+  core.setParams(params);
+  setRoute(straightRoute(5, 2.0));
+  world.stuck = true; // 最初から動かない
+  core.start(now, 0);
+  runFor(9.5); // warm-up(5s) + stall_timeout(5s)まではabortしない
+  EXPECT_EQ(1u, world.sent_waypoints.size());
+  runFor(1.0);
+  EXPECT_EQ(2u, world.sent_waypoints.size());
+}
+
+TEST_F(NavigatorCoreTest, LostPoseAbortsAndRetries)
+{
+  NavigatorCore::Params params;
+  params.pose_lost_timeout = 3.0;
+  core.setParams(params);
+  setRoute(straightRoute(5, 2.0));
+  core.start(now, 0);
+  runFor(1.0);
+  world.pose_lost = true;
+  world.stuck = true;
+  runFor(2.5);
+  EXPECT_EQ(1u, world.sent_waypoints.size()); // timeoutまでは待つ
+  runFor(1.0);
+  ASSERT_EQ(2u, world.sent_waypoints.size());
+  EXPECT_EQ(0, world.sent_waypoints.back()); // 同じwaypointをやり直す
+  EXPECT_EQ(1, world.leg_ends);
+  world.pose_lost = false;
+  world.stuck = false;
+  EXPECT_TRUE(runFor(100.0));
+}
+
+TEST_F(NavigatorCoreTest, LostPoseKeepsStallTimeout)
+{
+  NavigatorCore::Params params;
+  params.pose_lost_timeout = 1000.0;
+  params.progress.window = 2.0;
+  params.progress.stall_timeout = 5.0;
+  core.setParams(params);
+  setRoute(straightRoute(5, 2.0));
+  world.stuck = true;
+  core.start(now, 0);
+  runFor(2.0);
+  ASSERT_EQ(ProgressMonitor::STALLED, core.progressMonitor().state());
+  ASSERT_EQ(1u, world.sent_waypoints.size());
+  world.pose_lost = true;
+  runFor(10.0);
+  EXPECT_GT(world.sent_waypoints.size(), 1u); // 位置が無くてもstall_timeoutでabortする
+}
+
+TEST_F(NavigatorCoreTest, StopAreaWaitsForFlag)
+{
+  std::vector<cirkit_waypoint_io::WaypointRecord> records = straightRoute(5, 2.0);
+  records[2].area_type = 2;
+  setRoute(records);
+  world.go_flag = false;
+  core.start(now, 0);
+  EXPECT_FALSE(runFor(30.0));
+  EXPECT_EQ(RobotBehaviors::WAITING_FLAG, core.state());
+  EXPECT_EQ(3u, world.sent_waypoints.size());
+  world.go_flag = true;
+  EXPECT_TRUE(runFor(100.0));
+  EXPECT_EQ(5u, world.sent_waypoints.size());
+}
+
+TEST_F(NavigatorCoreTest, AreaTypeIsAppliedOnChange)
+{
+  std::vector<cirkit_waypoint_io::WaypointRecord> records = straightRoute(6, 2.0);
+  records[2].area_type = 3;
+  records[3].area_type = 3;
+  setRoute(records);
+  core.start(now, 0);
+  ASSERT_TRUE(runFor(100.0));
+  std::vector<int> expected = {0, 3, 0};
+  EXPECT_EQ(expected, world.applied_area_types);
+}
+
+TEST_F(NavigatorCoreTest, SearchAreaApproachesTarget)
+{
+  std::vector<cirkit_waypoint_io::WaypointRecord> records = straightRoute(6, 2.0);
+  records[3].area_type = 1;
+  setRoute(records);
+  Pose2D target = {6.0, 3.0, 0.0};
+  world.targets.push_back(target);
+  core.start(now, 0);
+  ASSERT_TRUE(runFor(100.0));
+  ASSERT_EQ(1u, world.sent_targets.size()); // 2回目はアプローチ済み
+  EXPECT_NEAR(1.0, hypot(world.sent_targets[0].x - target.x, world.sent_targets[0].y - target.y), 1e-6);
+  ASSERT_EQ(1u, world.reported_targets.size());
+  EXPECT_DOUBLE_EQ(target.x, world.reported_targets[0].x);
+  EXPECT_DOUBLE_EQ(target.y, world.reported_targets[0].y);
+  std::vector<int> expected = {0, 1, 2, 3, 4, 5}; // 探索対象のあとでwaypoint 3に戻る
+  EXPECT_EQ(expected, world.sent_waypoints);
+}
+
+TEST_F(NavigatorCoreTest, InvalidTargetRadiusIsRejected)
+{
+  NavigatorCore::Params params;
+  params.approached_target_radius = 0.0;
+  core.setParams(params);
+  EXPECT_DOUBLE_EQ(NavigatorCore::Params().approached_target_radius,
+                   core.params().approached_target_radius);
+  params.approached_target_radius = NAN;
+  core.setParams(params);
+  EXPECT_DOUBLE_EQ(NavigatorCore::Params().approached_target_radius,
+                   core.params().approached_target_radius);
+  params.approached_target_radius = 2.0;
+  core.setParams(params);
+  EXPECT_DOUBLE_EQ(2.0, core.params().approached_target_radius);
+}
+
+TEST_F(NavigatorCoreTest, RelocalizeJumpsToWaypoint)
+{
+  setRoute(straightRoute(10, 2.0));
+  core.start(now, 0);
+  runFor(1.0);
+  core.relocalize(7);
+  world.robot.x = 15.0;
+  runFor(0.1);
+  EXPECT_EQ(RobotBehaviors::RELOCALIZED, core.state());
+  ASSERT_TRUE(runFor(100.0));
+  std::vector<int> expected = {0, 7, 8, 9};
+  EXPECT_EQ(expected, world.sent_waypoints);
+}
+
+TEST_F(NavigatorCoreTest, LookaheadChainsWaypoints)
+{
+  NavigatorCore::Params params;
+  params.lookahead_distance = 1.5;
+  core.setParams(params);
+  setRoute(straightRoute(5, 2.0));
+  core.start(now, 0);
+  double max_distance_at_switch = 0.0;
+  size_t sent = world.sent_waypoints.size();
+  while (core.tick(now) && now < 100.0) {
+    world.step(0.1);
+    now += 0.1;
+    if (world.sent_waypoints.size() != sent && sent > 0) {
+      int previous = world.sent_waypoints[sent - 1];
+      max_distance_at_switch = std::max(max_distance_at_switch,
+                                        fabs(core.route().x(previous) - world.robot.x));
+      sent = world.sent_waypoints.size();
+    }
+  }
+  EXPECT_TRUE(core.finished());
+  EXPECT_GT(max_distance_at_switch, 0.5); // reach_thresholdより手前で次に切り替わる
+  EXPECT_EQ(5u, world.sent_waypoints.size());
+}
+
+// ランダムなイベントを与えても状態がおかしくならないこと
+TEST_F(NavigatorCoreTest, FuzzInvariants)
+{
+  srand(1);
+  std::vector<cirkit_waypoint_io::WaypointRecord> records = straightRoute(50, 2.0);
+  for (size_t i = 0; i < records.size(); ++i) {
+    records[i].area_type = rand() % 4;
+  }
+  setRoute(records);
+  core.start(now, -1);
+  const int size = (int)records.size();
+  for (int i = 0; i < 1000000; ++i) {
+    int event = rand() % 1000;
+    if (event == 0) {
+      world.abort_next = true;
+    } else if (event == 1) {
+      world.stuck = !world.stuck;
+    } else if (event == 2) {
+      core.relocalize(rand() % (size + 1) - 1);
+    } else if (event == 3) {
+      world.go_flag = !world.go_flag;
+    } else if (event == 4) {
+      world.targets.clear();
+      Pose2D target = {world.robot.x + (rand() % 100) * 0.1 - 5.0,
+                       (rand() % 100) * 0.1 - 5.0, 0.0};
+      world.targets.push_back(target);
+    } else if (event == 5) {
+      world.robot.x = (rand() % 1000) * 0.1;
+    }
+    world.step(0.05);
+    now += 0.05;
+    if (!core.tick(now)) {
+      core.start(now, rand() % size);
+    }
+    ASSERT_GE(core.targetWaypointIndex(), 0);
+    ASSERT_LE(core.targetWaypointIndex(), size);
+    ASSERT_LE(world.leg_ends, world.leg_starts);
+    ASSERT_GE(world.leg_ends + 1, world.leg_starts);
+  }
+  EXPECT_GT(core.legCount(), 0);
+}
+
+TEST_F(NavigatorCoreTest, TickThroughput)
+{
+  setRoute(straightRoute(1000, 2.0));
+  world.speed = 10.0;
+  core.start(now, 0);
+  const int ticks = 2000000;
+  int count = 0;
+  std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+  for (; count < ticks; ++count) {
+    world.step(0.01);
+    now += 0.01;
+    if (!core.tick(now)) {
+      core.start(now, 0);
+    }
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  std::cout << "[ PERF     ] " << count / elapsed << " ticks/s, "
+            << core.legCount() / elapsed << " legs/s" << std::endl;
+  EXPECT_GT(core.legCount(), 0);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "scan_roi_counter.h"
+
+namespace {
+
+std::vector<float> makeVector(const float *values, size_t size) {
+  return std::vector<float>(values, values + size);
+}
+
+// 1度刻みで一周, 距離は全部range
+std::vector<float> makeRanges(float range) {
+  return std::vector<float>(360, range);
+}
+
+const float kAngleMin = (float)-M_PI;
+const float kAngleIncrement = (float)(M_PI / 180.0);
+
+TEST(ScanRoiCounterTest, CountsBeamsInBox)
+{
+  ScanRoiCounter counter;
+  ASSERT_EQ(0, counter.addBox(0.5f, -0.45f, 2.0f, 0.45f)); // 前方
+  ASSERT_EQ(1, counter.addBox(-2.0f, -0.45f, -0.5f, 0.45f)); // 後方
+  std::vector<float> ranges = makeRanges(1.0f);
+  ranges[180] = NAN; // 0度
+  int counts[2] = {0, 0};
+  counter.count(kAngleMin, kAngleIncrement, ranges.data(), ranges.size(), 0.1f, 10.0f, counts);
+  // 距離1mの円と |y| <= 0.45 が重なるのは正面/真後ろから26.7度まで
+  EXPECT_EQ(52, counts[0]); // -26..26度の53本からNaNを除く
+  EXPECT_EQ(53, counts[1]); // -180..-154度と154..179度
+}
+
+TEST(ScanRoiCounterTest, AcceptsConvexPolygonInEitherDirection)
+{
+  const float xs[] = {0.0f, 1.0f, 1.0f, 0.5f, 0.0f};
+  const float ys[] = {0.0f, 0.0f, 1.0f, 1.0f, 1.0f}; // (0.5, 1)は辺の上
+  ScanRoiCounter counter;
+  EXPECT_EQ(0, counter.addPolygon(makeVector(xs, 5), makeVector(ys, 5)));
+  std::vector<float> rxs(xs, xs + 5), rys(ys, ys + 5);
+  std::reverse(rxs.begin(), rxs.end());
+  std::reverse(rys.begin(), rys.end());
+  EXPECT_EQ(1, counter.addPolygon(rxs, rys));
+}
+
+TEST(ScanRoiCounterTest, RejectsConcavePolygon)
+{
+  // L字. 半平面で数えると(1, 1)-(2, 2)の欠けたところまで数えてしまう
+  const float xs[] = {0.0f, 2.0f, 2.0f, 1.0f, 1.0f, 0.0f};
+  const float ys[] = {0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f};
+  ScanRoiCounter counter;
+  EXPECT_EQ(-1, counter.addPolygon(makeVector(xs, 6), makeVector(ys, 6)));
+  EXPECT_EQ(0u, counter.roiCount());
+}
+
+TEST(ScanRoiCounterTest, RejectsSelfIntersectingPolygon)
+{
+  // 五芒星. どの頂点でも同じ向きに曲がるが, 辺が交差している
+  std::vector<float> xs, ys;
+  for (int i = 0; i < 5; ++i) {
+    double angle = 2.0 * M_PI * (2 * i) / 5.0;
+    xs.push_back((float)cos(angle));
+    ys.push_back((float)sin(angle));
+  }
+  ScanRoiCounter counter;
+  EXPECT_EQ(-1, counter.addPolygon(xs, ys));
+  EXPECT_EQ(0u, counter.roiCount());
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}